@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+
+#include "cumulative.h"
+
+#include <math.h>
+#include <memory.h>
+#include <stdio.h>
+#include <string.h>
+
+int
+hist_index_build(struct hist_index *idx, const size_t *h, size_t bin_count,
+        double min, double max) {
+    if (!idx || !h || bin_count == 0) {
+        EINVALID_ARGS("hist_index_build");
+        return 1;
+    }
+
+    memset(idx, 0, sizeof(*idx));
+    idx->bin_count = bin_count;
+    idx->min = min < max ? min : max;
+    idx->max = min < max ? max : min;
+
+    idx->owned_len = bin_count + 1;
+    idx->owned = (size_t *)alloc_block(sizeof(size_t) * idx->owned_len);
+    if (!idx->owned) return 1;
+
+    idx->owned[0] = 0;
+    for (size_t i = 0; i < bin_count; i++) {
+        idx->owned[i + 1] = idx->owned[i] + h[i];
+    }
+    idx->prefix = idx->owned;
+
+    return 0;
+}
+
+/// Set up a sparse index with room for pair_count (bin, count) pairs,
+/// filled in by the caller before accumulate_pairs
+static int
+sparse_index_init(struct hist_index *idx, size_t pair_count,
+        size_t bin_count, double min, double max) {
+    memset(idx, 0, sizeof(*idx));
+    idx->bin_count = bin_count;
+    idx->min = min < max ? min : max;
+    idx->max = min < max ? max : min;
+    idx->pair_count = pair_count;
+
+    idx->owned_len = pair_count > 0 ? 2 * pair_count : 1;
+    idx->owned = (size_t *)alloc_block(sizeof(size_t) * idx->owned_len);
+    if (!idx->owned) return 1;
+    idx->pairs = idx->owned;
+
+    return 0;
+}
+
+/// Turn the counts of the pairs into running totals
+static void
+accumulate_pairs(struct hist_index *idx) {
+    size_t total = 0;
+    for (size_t i = 0; i < idx->pair_count; i++) {
+        total += idx->owned[2 * i + 1];
+        idx->owned[2 * i + 1] = total;
+    }
+}
+
+int
+hist_index_build_sparse(struct hist_index *idx, const struct sparse_hist *sh,
+        double min, double max) {
+    if (!idx || !sh) {
+        EINVALID_ARGS("hist_index_build_sparse");
+        return 1;
+    }
+
+    size_t *order = sparse_hist_sorted_bins(sh);
+    if (!order) return 1;
+
+    int result = sparse_index_init(idx, sh->used, sh->bin_count, min, max);
+    for (size_t i = 0; result == 0 && i < sh->used; i++) {
+        idx->owned[2 * i] = order[i];
+        idx->owned[2 * i + 1] = sparse_hist_get(sh, order[i]);
+    }
+    if (result == 0) accumulate_pairs(idx);
+
+    free(order);
+
+    return result;
+}
+
+/// Index of a sparse binary histogram file
+static int
+hist_index_load_sparse_hist(struct hist_index *idx, const char *filename) {
+    struct hist_map map;
+    size_t pair_count;
+    if (map_pairs_file(filename, HIST_SPARSE_MAGIC, &map, &pair_count) != 0)
+        return 1;
+
+    int result = sparse_index_init(idx, pair_count, map.header->bin_count,
+            map.header->min, map.header->max);
+    if (result == 0) {
+        memcpy(idx->owned, map.counts, sizeof(size_t) * 2 * pair_count);
+        accumulate_pairs(idx);
+    }
+    unmap_hist_file(&map);
+
+    return result;
+}
+
+/// Map a sparse index file
+static int
+hist_index_load_sparse(struct hist_index *idx, const char *filename) {
+    if (map_pairs_file(filename, HIST_SPARSE_INDEX_MAGIC, &idx->map,
+                &idx->pair_count) != 0)
+        return 1;
+
+    idx->bin_count = idx->map.header->bin_count;
+    idx->min = idx->map.header->min;
+    idx->max = idx->map.header->max;
+    idx->pairs = idx->map.counts;
+
+    // Binary search relies on running totals
+    for (size_t i = 1; i < idx->pair_count; i++) {
+        if (idx->pairs[2 * i + 1] < idx->pairs[2 * i - 1]) {
+            ERROR("hist_index_load", "cumulative counts decrease");
+            hist_index_destroy(idx);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+hist_index_load(struct hist_index *idx, const char *filename) {
+    if (!idx || !filename) {
+        EINVALID_ARGS("hist_index_load");
+        return 1;
+    }
+
+    struct hist_bin_header header;
+    if (read_hist_header(filename, &header) == 0) {
+        if (header.magic == HIST_SPARSE_MAGIC)
+            return hist_index_load_sparse_hist(idx, filename);
+
+        struct hist_map map;
+        if (map_hist_file(filename, &map) != 0) return 1;
+
+        int result = hist_index_build(idx, map.counts,
+                map.header->bin_count, map.header->min, map.header->max);
+        unmap_hist_file(&map);
+
+        return result;
+    }
+
+    memset(idx, 0, sizeof(*idx));
+
+    // read_hist_header leaves the magic of other files it could read
+    if (header.magic == HIST_SPARSE_INDEX_MAGIC)
+        return hist_index_load_sparse(idx, filename);
+
+    if (map_counts_file(filename, HIST_INDEX_MAGIC, 1, &idx->map) != 0)
+        return 1;
+
+    idx->bin_count = idx->map.header->bin_count;
+    idx->min = idx->map.header->min;
+    idx->max = idx->map.header->max;
+    idx->prefix = idx->map.counts;
+
+    return 0;
+}
+
+void
+hist_index_destroy(struct hist_index *idx) {
+    if (!idx) return;
+
+    if (idx->owned) free_block(idx->owned, sizeof(size_t) * idx->owned_len);
+    unmap_hist_file(&idx->map);
+    memset(idx, 0, sizeof(*idx));
+}
+
+int
+save_hist_index(const struct hist_index *idx, const char *filename) {
+    if (!idx || !filename) return 1;
+
+    if (idx->pairs)
+        return save_counts_to_binary_file(HIST_SPARSE_INDEX_MAGIC,
+                idx->pairs, 2 * idx->pair_count, idx->bin_count, idx->min,
+                idx->max, filename);
+
+    return save_counts_to_binary_file(HIST_INDEX_MAGIC, idx->prefix,
+            idx->bin_count + 1, idx->bin_count, idx->min, idx->max,
+            filename);
+}
+
+int
+save_hist_index_for(const size_t *h, size_t bin_count,
+        double min, double max, const char *ofname) {
+    if (!ofname) return 1;
+
+    char *fname = NULL;
+    if (asprintf(&fname, "%s" HIST_INDEX_EXT, ofname) == -1) {
+        perror("asprintf");
+        return 1;
+    }
+
+    struct hist_index idx;
+    int result = hist_index_build(&idx, h, bin_count, min, max);
+    if (result == 0) {
+        result = save_hist_index(&idx, fname);
+        hist_index_destroy(&idx);
+    }
+
+    free(fname);
+
+    return result;
+}
+
+int
+save_sparse_hist_index_for(const struct sparse_hist *sh,
+        double min, double max, const char *ofname) {
+    if (!sh || !ofname) return 1;
+
+    char *fname = NULL;
+    if (asprintf(&fname, "%s" HIST_INDEX_EXT, ofname) == -1) {
+        perror("asprintf");
+        return 1;
+    }
+
+    struct hist_index idx;
+    int result = hist_index_build_sparse(&idx, sh, min, max);
+    if (result == 0) {
+        result = save_hist_index(&idx, fname);
+        hist_index_destroy(&idx);
+    }
+
+    free(fname);
+
+    return result;
+}
+
+/// Number of items in bins before bin i
+static size_t
+prefix_at(const struct hist_index *idx, size_t i) {
+    if (idx->prefix) return idx->prefix[i];
+
+    // Running total of the last occupied bin before i
+    size_t lo = 0, hi = idx->pair_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->pairs[2 * mid] < i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo > 0 ? idx->pairs[2 * lo - 1] : 0;
+}
+
+size_t
+hist_index_bin_range(const struct hist_index *idx, size_t first, size_t last) {
+    if (!idx || first > last || first >= idx->bin_count) return 0;
+    if (last >= idx->bin_count) last = idx->bin_count - 1;
+
+    return prefix_at(idx, last + 1) - prefix_at(idx, first);
+}
+
+/// Estimated number of items less than x
+static double
+cumulative_at(const struct hist_index *idx, double x) {
+    if (x <= idx->min) return 0.0;
+    if (x >= idx->max) return (double)prefix_at(idx, idx->bin_count);
+
+    double bin_width = (idx->max - idx->min) / (double)idx->bin_count;
+    double q = (x - idx->min) / bin_width;
+    size_t i = (size_t)q;
+    if (i >= idx->bin_count) i = idx->bin_count - 1;
+
+    size_t below = prefix_at(idx, i);
+    double in_bin = (double)(prefix_at(idx, i + 1) - below);
+
+    return (double)below + in_bin * (q - (double)i);
+}
+
+double
+hist_index_range_count(const struct hist_index *idx, double a, double b) {
+    if (!idx || idx->bin_count == 0) return 0.0;
+
+    if (a > b) {
+        double t = a;
+        a = b;
+        b = t;
+    }
+
+    // A degenerate histogram has everything in its first bin
+    if (idx->min == idx->max)
+        return a <= idx->min && idx->min <= b ?
+            (double)prefix_at(idx, idx->bin_count) : 0.0;
+
+    return cumulative_at(idx, b) - cumulative_at(idx, a);
+}
+
+double
+hist_index_quantile(const struct hist_index *idx, double p) {
+    if (!idx || idx->bin_count == 0) return NAN;
+
+    size_t total = prefix_at(idx, idx->bin_count);
+    if (total == 0) return NAN;
+
+    if (p < 0.0) p = 0.0;
+    if (p > 1.0) p = 1.0;
+    double target = p * (double)total;
+
+    // Find the first bin whose cumulative count reaches target
+    size_t bin;
+    size_t below, in_bin;
+    if (idx->prefix) {
+        size_t lo = 0, hi = idx->bin_count - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((double)idx->prefix[mid + 1] >= target &&
+                    idx->prefix[mid + 1] > 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        bin = lo;
+        below = idx->prefix[lo];
+        in_bin = idx->prefix[lo + 1] - below;
+    } else {
+        size_t lo = 0, hi = idx->pair_count - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if ((double)idx->pairs[2 * mid + 1] >= target &&
+                    idx->pairs[2 * mid + 1] > 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+
+        bin = idx->pairs[2 * lo];
+        below = lo > 0 ? idx->pairs[2 * lo - 1] : 0;
+        in_bin = idx->pairs[2 * lo + 1] - below;
+    }
+
+    double bin_width = (idx->max - idx->min) / (double)idx->bin_count;
+    double frac = in_bin > 0 ? (target - (double)below) / (double)in_bin : 0.0;
+
+    return idx->min + bin_width * ((double)bin + frac);
+}
@@ -0,0 +1,113 @@
+#ifndef PROJECT1_CUMULATIVE_H
+#define PROJECT1_CUMULATIVE_H
+
+#include <stdlib.h>
+
+#include "helper.h"
+#include "sparse.h"
+
+#define HIST_INDEX_EXT ".idx"
+
+/// "HIDX" in a little-endian file
+#define HIST_INDEX_MAGIC 0x58444948U
+
+/// "HSIX" in a little-endian file
+#define HIST_SPARSE_INDEX_MAGIC 0x58495348U
+
+/// Cumulative counts of a histogram, prefix[i] is the number of items in
+/// bins before bin i, prefix[bin_count] is the total. The index of a
+/// sparse histogram has pairs instead, (bin, items up to and including
+/// bin) for occupied bins in increasing bin order, and prefix is NULL.
+struct hist_index {
+    size_t          bin_count;
+    double          min;
+    double          max;
+    const size_t    *prefix;
+    const size_t    *pairs;
+    size_t          pair_count;
+    size_t          *owned;
+    size_t          owned_len;
+    struct hist_map map;
+};
+
+/// Build cumulative counts of a histogram
+/// \param idx Index to initialize, released with hist_index_destroy
+/// \param h Histogram
+/// \param bin_count Number of bins
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+int
+hist_index_build(struct hist_index *idx, const size_t *h, size_t bin_count,
+        double min, double max);
+
+/// Build the sparse index of a sparse histogram
+/// \param idx Index to initialize, released with hist_index_destroy
+/// \param sh Sparse histogram
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+int
+hist_index_build_sparse(struct hist_index *idx, const struct sparse_hist *sh,
+        double min, double max);
+
+/// Load an index file, or build the index of a binary histogram file.
+/// Sparse index and histogram files give a sparse index.
+/// \param idx Index to initialize, released with hist_index_destroy
+/// \param filename Name of the index or binary histogram file
+int
+hist_index_load(struct hist_index *idx, const char *filename);
+
+/// Release an index
+/// \param idx Index to release
+void
+hist_index_destroy(struct hist_index *idx);
+
+/// Write an index file
+/// \param idx Index to write
+/// \param filename Name of the file to write
+int
+save_hist_index(const struct hist_index *idx, const char *filename);
+
+/// Build and write the index of a histogram to <ofname>.idx
+/// \param h Histogram
+/// \param bin_count Number of bins
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param ofname Name of the histogram file the index belongs to
+int
+save_hist_index_for(const size_t *h, size_t bin_count,
+        double min, double max, const char *ofname);
+
+/// Write the sparse index of a sparse histogram to <ofname>.idx
+/// \param sh Sparse histogram
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param ofname Name of the histogram file the index belongs to
+int
+save_sparse_hist_index_for(const struct sparse_hist *sh,
+        double min, double max, const char *ofname);
+
+/// Number of items in bins first to last, inclusive, in O(1), or in
+/// O(log occupied bins) with a sparse index
+/// \param idx Index
+/// \param first First bin
+/// \param last Last bin
+size_t
+hist_index_bin_range(const struct hist_index *idx, size_t first, size_t last);
+
+/// Estimated number of items in [a, b], in the time of
+/// hist_index_bin_range. Items are taken to be spread evenly inside a
+/// partially covered bin.
+/// \param idx Index
+/// \param a Lower end of the range
+/// \param b Upper end of the range
+double
+hist_index_range_count(const struct hist_index *idx, double a, double b);
+
+/// p-th quantile in O(log bins), interpolated inside its bin
+/// \param idx Index
+/// \param p Quantile in [0, 1]
+/// \return The quantile, NaN if the histogram is empty
+double
+hist_index_quantile(const struct hist_index *idx, double p);
+
+#endif //PROJECT1_CUMULATIVE_H
@@ -0,0 +1,105 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "helper.h"
+#include "kernels.h"
+
+#define DEFAULT_SAMPLES 10000000UL
+
+#define REPEAT 5
+
+struct bench_config {
+    const char  *name;
+    double      min;
+    double      max;
+    size_t      bin_count;
+    int         integers;
+};
+
+static const struct bench_config configs[] = {
+    { "integers, width 1",      1.0, 1025.0, 1024, 1 },
+    { "integers, width 16",     0.0, 65536.0, 4096, 1 },
+    { "integers, width 0.75",   0.0, 768.0, 1024, 1 },
+    { "reals, width 1",         1.0, 1025.0, 1024, 0 },
+    { "reals, width 0.01",      -5.0, 5.0, 1000, 0 },
+};
+
+static double
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+int
+main(int argc, char **argv) {
+    size_t n = DEFAULT_SAMPLES;
+    if (argc > 1) sscanf(argv[1], "%lu", &n);
+
+    double *src = (double *)alloc_block(sizeof(double) * n);
+    if (src == NULL) return 1;
+
+    int result = 0;
+    srand(342);
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        const struct bench_config *cfg = &configs[c];
+        double span = cfg->max - cfg->min;
+
+        // Some numbers fall outside [min, max] and on edges
+        for (size_t i = 0; i < n; i++) {
+            double x = cfg->min - span * 0.05 +
+                span * 1.1 * ((double)rand() / RAND_MAX);
+            src[i] = cfg->integers ? (double)(long)x : x;
+        }
+
+        size_t *reference = calloc(cfg->bin_count, sizeof(size_t));
+        size_t *h = calloc(cfg->bin_count, sizeof(size_t));
+        if (reference == NULL || h == NULL) {
+            perror("calloc");
+            return 1;
+        }
+
+        hist_run_kernel(HIST_KERNEL_GENERIC, src, n, cfg->min, cfg->max,
+                cfg->bin_count, reference);
+
+        enum hist_kernel selected = hist_select_kernel(src, n,
+                cfg->min, cfg->max, cfg->bin_count);
+        printf("%s, %lu bins, selected %s\n", cfg->name, cfg->bin_count,
+                hist_kernel_name(selected));
+
+        for (int k = 0; k < HIST_KERNEL_COUNT; k++) {
+            if (!hist_kernel_applies(k, cfg->min, cfg->max, cfg->bin_count))
+                continue;
+
+            double best = 0.0;
+            for (int r = 0; r < REPEAT; r++) {
+                memset(h, 0, sizeof(size_t) * cfg->bin_count);
+
+                double start = now();
+                hist_run_kernel(k, src, n, cfg->min, cfg->max,
+                        cfg->bin_count, h);
+                double elapsed = now() - start;
+
+                if (r == 0 || elapsed < best) best = elapsed;
+            }
+
+            int same = memcmp(h, reference,
+                    sizeof(size_t) * cfg->bin_count) == 0;
+            if (!same) result = 1;
+
+            printf("\t%-8s %8.3f ns/number %s\n", hist_kernel_name(k),
+                    best * 1e9 / (double)n, same ? "" : "MISMATCH");
+        }
+
+        safe_free(reference, sizeof(size_t) * cfg->bin_count);
+        safe_free(h, sizeof(size_t) * cfg->bin_count);
+    }
+
+    free_block(src, sizeof(double) * n);
+
+    return result;
+}
@@ -0,0 +1,293 @@
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "net.h"
+
+#define COORD_MAX_WORKERS 256
+
+#define COORD_MAX_ATTEMPTS 3
+
+#define COORD_POLL_MS 100
+
+enum shard_state { SHARD_PENDING, SHARD_RUNNING, SHARD_DONE };
+
+struct shard {
+    const char         *path;
+    enum shard_state    state;
+    double              assigned_at;    // when the newest copy started
+    size_t              running;        // workers holding a copy
+    size_t              failures;
+};
+
+struct coord {
+    struct shard   *shards;
+    size_t          shard_count;
+    size_t          done_count;
+    double          straggler_after;
+    struct pollfd   fds[COORD_MAX_WORKERS + 1]; // listener first
+    ssize_t         held[COORD_MAX_WORKERS + 1];  // shard per worker, or -1
+    size_t          fd_count;
+};
+
+
+static void
+print_coord_usage(void) {
+    printf("Usage:\n");
+    printf("\thcoord [-p PORT] [-t SECONDS] [MINVAL] [MAXVAL] [BINCOUNT]"
+           " [FILECOUNT] [IFILE]... [OFILE]\n");
+    printf("\t-p\tPort workers connect to, defaults to "
+           NET_DEFAULT_PORT "\n");
+    printf("\t-t\tSeconds after which an idle worker also runs a shard\n");
+}
+
+static double
+now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/// Give the worker in slot w a shard: a pending one first, otherwise a
+/// copy of one running longer than straggler_after with a single holder
+static int
+assign_shard(struct coord *c, size_t w) {
+    ssize_t pick = -1;
+    double t = now();
+
+    for (size_t s = 0; s < c->shard_count && pick == -1; s++) {
+        if (c->shards[s].state == SHARD_PENDING) pick = (ssize_t)s;
+    }
+
+    for (size_t s = 0; s < c->shard_count && pick == -1; s++) {
+        struct shard *sh = &c->shards[s];
+        if (sh->state == SHARD_RUNNING && sh->running == 1 &&
+                t - sh->assigned_at >= c->straggler_after)
+            pick = (ssize_t)s;
+    }
+
+    if (pick == -1) return 0;
+
+    struct shard *sh = &c->shards[pick];
+    if (net_send(c->fds[w].fd, NET_ASSIGN, (uint64_t)pick,
+                sh->path, strlen(sh->path)) != 0)
+        return 1;
+
+    sh->state = SHARD_RUNNING;
+    sh->assigned_at = t;
+    sh->running++;
+    c->held[w] = pick;
+
+    return 0;
+}
+
+/// Drop the worker in slot w, handing its shard back if nobody else has it
+static void
+drop_worker(struct coord *c, size_t w) {
+    ssize_t s = c->held[w];
+    if (s != -1 && c->shards[s].state == SHARD_RUNNING &&
+            --c->shards[s].running == 0)
+        c->shards[s].state = SHARD_PENDING;
+
+    close(c->fds[w].fd);
+
+    c->fd_count--;
+    c->fds[w] = c->fds[c->fd_count];
+    c->held[w] = c->held[c->fd_count];
+}
+
+/// Read one message from the worker in slot w and merge a result
+/// \return 0 to keep the worker, 1 to drop it, -1 if the job failed
+static int
+handle_worker(struct coord *c, size_t w, size_t *h, size_t bin_count) {
+    struct net_msg msg;
+    void *payload;
+
+    if (net_recv(c->fds[w].fd, &msg, &payload,
+                net_hist_max_length(bin_count)) != 0)
+        return 1;
+
+    ssize_t s = c->held[w];
+    if (s == -1 || msg.shard != (uint64_t)s) {
+        ERROR("hcoord", "result for a shard not assigned");
+        free(payload);
+        return 1;
+    }
+
+    struct shard *sh = &c->shards[s];
+    int result = 0;
+
+    if (msg.type == NET_FAIL) {
+        fprintf(stderr, "hcoord: worker could not read %s\n", sh->path);
+        if (++sh->failures >= COORD_MAX_ATTEMPTS) result = -1;
+    } else if (sh->state != SHARD_DONE) {
+        // First result wins, so every shard is added exactly once
+        if (net_add_hist(&msg, payload, h, bin_count) != 0) {
+            ERROR("hcoord", "malformed result");
+            free(payload);
+            return 1;
+        }
+        sh->state = SHARD_DONE;
+        c->done_count++;
+    }
+
+    free(payload);
+
+    if (sh->state == SHARD_RUNNING && --sh->running == 0)
+        sh->state = SHARD_PENDING;
+    c->held[w] = -1;
+
+    return result;
+}
+
+/// Hand out shards until every one is merged into h
+static int
+run_coordinator(struct coord *c, size_t *h, size_t bin_count,
+        const struct net_job *job) {
+    while (c->done_count < c->shard_count) {
+        if (poll(c->fds, c->fd_count, COORD_POLL_MS) == -1) {
+            perror("poll");
+            return 1;
+        }
+
+        if (c->fds[0].revents & POLLIN) {
+            int fd = accept(c->fds[0].fd, NULL, NULL);
+            if (fd == -1) {
+                perror("accept");
+            } else if (c->fd_count == COORD_MAX_WORKERS + 1 ||
+                    net_send(fd, NET_JOB, 0, job, sizeof(*job)) != 0) {
+                close(fd);
+            } else {
+                c->fds[c->fd_count].fd = fd;
+                c->fds[c->fd_count].events = POLLIN;
+                c->fds[c->fd_count].revents = 0;
+                c->held[c->fd_count] = -1;
+                c->fd_count++;
+            }
+        }
+
+        for (size_t w = 1; w < c->fd_count; w++) {
+            if (!c->fds[w].revents) continue;
+
+            int handled = handle_worker(c, w, h, bin_count);
+            if (handled == -1) return 1;
+            if (handled == 1) {
+                drop_worker(c, w);
+                w--;
+            }
+        }
+
+        for (size_t w = 1; w < c->fd_count; w++) {
+            c->fds[w].revents = 0;
+            if (c->held[w] == -1 && assign_shard(c, w) != 0) {
+                drop_worker(c, w);
+                w--;
+            }
+        }
+    }
+
+    for (size_t w = 1; w < c->fd_count; w++) {
+        net_send(c->fds[w].fd, NET_DONE, 0, NULL, 0);
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    const char *port = NET_DEFAULT_PORT;
+    double straggler_after = 10;
+
+    int arg = 1;
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+            port = argv[++arg];
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+            sscanf(argv[++arg], "%lf", &straggler_after);
+        } else {
+            break;
+        }
+    }
+
+    // Skip options so positional arguments start at argv[1]
+    argc -= arg - 1;
+    argv += arg - 1;
+
+    if (argc < 6) {
+        print_coord_usage();
+        return 0;
+    }
+
+    struct net_job job;
+    size_t file_count;
+
+    sscanf(argv[1], "%lf", &job.min);
+    sscanf(argv[2], "%lf", &job.max);
+    sscanf(argv[3], "%lu", &job.bin_count);
+    sscanf(argv[4], "%lu", &file_count);
+
+    if ((size_t)argc < (6U + file_count) || job.bin_count == 0) {
+        print_coord_usage();
+        return 0;
+    }
+
+    size_t bin_count = job.bin_count;
+    const char *ofname = argv[5U + file_count];
+
+    struct coord c;
+    memset(&c, 0, sizeof(c));
+    c.shard_count = file_count;
+    c.straggler_after = straggler_after;
+
+    // Workers resolve paths themselves, so hand them out absolute
+    c.shards = (struct shard *)calloc(file_count + 1, sizeof(struct shard));
+    char **paths = (char **)calloc(file_count + 1, sizeof(char *));
+    if (!c.shards || !paths) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < file_count; i++) {
+        paths[i] = realpath(argv[5 + i], NULL);
+        if (!paths[i]) {
+            perror(argv[5 + i]);
+            exit(EXIT_FAILURE);
+        }
+        c.shards[i].path = paths[i];
+    }
+
+    size_t *result_hist = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    if (result_hist == NULL) exit(EXIT_FAILURE);
+    memset(result_hist, 0, sizeof(size_t) * bin_count);
+
+    c.fds[0].fd = net_listen(port);
+    c.fds[0].events = POLLIN;
+    c.fd_count = 1;
+    if (c.fds[0].fd == -1) exit(EXIT_FAILURE);
+
+    int status = run_coordinator(&c, result_hist, bin_count, &job);
+
+    for (size_t w = 0; w < c.fd_count; w++) {
+        close(c.fds[w].fd);
+    }
+
+    if (status == 0)
+        status = save_hist(result_hist, bin_count, job.min, job.max,
+                ofname, 1);
+
+    for (size_t i = 0; i < file_count; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(c.shards);
+    free_block(result_hist, sizeof(size_t) * bin_count);
+
+    exit(status == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
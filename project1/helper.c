@@ -1,48 +1,78 @@
+#define _GNU_SOURCE
+
 #include "helper.h"
+#include "input.h"
+#include "kernels.h"
+#include "sparse.h"
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <memory.h>
+#include <sched.h>
 #include <stdio.h>
 #include <unistd.h>
 
+static int huge_pages = 0;
+static const char *hugetlbfs_dir = NULL;
+static const char *partial_hist_ext = HIST_TEXT_EXT;
+
 double *
-numbers_from_file(const char *filename, size_t n, size_t *read) {
-    if (!filename || !read || n == 0) {
+numbers_from_file(const char *filename, size_t *read, size_t *size) {
+    if (!filename || !read || !size) {
         EINVALID_ARGS("numbers_from_file");
         return NULL;
     }
 
-    FILE *f = fopen(filename, "r");
-    if (!f) {
-        perror("fopen");
-        return NULL;
-    }
+    // Compressed files are inflated as they are parsed
+    struct input in;
+    if (input_open(&in, filename) == -1) return NULL;
 
-    size_t size = sizeof(double) * n;
+    // Parsed in one pass, growing the array when the estimate falls short
+    size_t capacity = estimate_sample_count(filename);
+    if (capacity > NUMBERS_CHUNK) capacity = NUMBERS_CHUNK;
+    if (capacity == 0) capacity = 1;
 
-    double *result = (double *)malloc(size);
+    double *result = (double *)alloc_block(sizeof(double) * capacity);
     if (!result) {
-        perror("malloc");
-        fclose(f);
-        exit(1);
+        input_close(&in);
+        return NULL;
     }
 
-    double x = 0.0;
     *read = 0;
-    while (!feof(f) && *read < n) {
-        if (fscanf(f, "%lf", &x) != 1) {
-            perror("fscanf");
-            safe_free(result, size);
-            fclose(f);
+    ssize_t got;
+    while ((got = input_numbers(&in, result + *read, capacity - *read)) ==
+            (ssize_t)(capacity - *read)) {
+        double *grown = (double *)alloc_block(sizeof(double) * 2 * capacity);
+        if (!grown) {
+            free_block(result, sizeof(double) * capacity);
+            input_close(&in);
             return NULL;
         }
-        result[*read] = x;
-        (*read)++;
+
+        memcpy(grown, result, sizeof(double) * capacity);
+        free_block(result, sizeof(double) * capacity);
+        result = grown;
+        *read = capacity;
+        capacity *= 2;
     }
 
-    fclose(f);
+    // A stream cut short is reported by input_close, not as bad input
+    int closed = input_close(&in);
+    if (got == -1 && closed == 0)
+        fprintf(stderr, "numbers_from_file: %s: expected numbers\n",
+                filename);
+    if (got == -1 || closed == -1) {
+        free_block(result, sizeof(double) * capacity);
+        return NULL;
+    }
+
+    *read += (size_t)got;
+    *size = sizeof(double) * capacity;
+
     return result;
 }
 
@@ -55,28 +85,142 @@ safe_free(void *block, size_t size) {
     block = NULL;
 }
 
-size_t
-line_count(const char *filename) {
-    if (!filename) {
-        EINVALID_ARGS("line_count");
+void
+set_huge_pages(int enable, const char *hugetlbfs) {
+    huge_pages = enable;
+    hugetlbfs_dir = enable ? hugetlbfs : NULL;
+}
+
+static size_t
+huge_round(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+void *
+alloc_block(size_t size) {
+    if (!huge_pages || size < HUGE_PAGE_SIZE) {
+        void *block = malloc(size);
+        if (!block) perror("malloc");
+        return block;
     }
 
-    FILE *f = fopen(filename, "r");
+    size_t map_size = huge_round(size);
+
+    // Try explicit huge pages first, they may not be reserved
+    void *block = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (block != MAP_FAILED) return block;
+
+    // Fall back to transparent huge pages
+    block = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    madvise(block, map_size, MADV_HUGEPAGE);
+
+    return block;
+}
+
+void
+free_block(void *block, size_t size) {
+    if (!block) return;
+
+    if (!huge_pages || size < HUGE_PAGE_SIZE) {
+        safe_free(block, size);
+        return;
+    }
+
+    if (munmap(block, huge_round(size)) == -1)
+        perror("munmap");
+}
+
+int
+numa_node_count(void) {
+    char path[64];
+    int count = 0;
+
+    for (;;) {
+        snprintf(path, sizeof(path),
+                "/sys/devices/system/node/node%d/cpulist", count);
+        if (access(path, R_OK) == -1) break;
+        count++;
+    }
+
+    return count > 0 ? count : 1;
+}
+
+int
+pin_to_numa_node(int node) {
+    if (node < 0) return -1;
+
+    char path[64];
+    snprintf(path, sizeof(path),
+            "/sys/devices/system/node/node%d/cpulist", node);
+
+    FILE *f = fopen(path, "r");
     if (!f) {
-        perror("fopen");
-        return 0;
+        // No NUMA information, nothing to pin to
+        return node == 0 ? 0 : -1;
     }
 
-    char c;
-    size_t result = 0;
-    while (!feof(f)) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    // cpulist has the form "0-3,8-11"
+    int first, last;
+    int c = ',';
+    while (c == ',' && fscanf(f, "%d", &first) == 1) {
+        last = first;
         c = fgetc(f);
-        if (c == '\n') result++;
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1) break;
+            c = fgetc(f);
+        }
+
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
     }
 
     fclose(f);
 
-    return result;
+    if (CPU_COUNT(&set) == 0) return -1;
+
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+
+    return 0;
+}
+
+size_t
+estimate_sample_count(const char *filename) {
+    // Every number takes at least a digit and a separator
+    return input_size(filename) / 2;
+}
+
+size_t
+hist_bin_index(double x, double min, double max, size_t bin_count) {
+    if (!(x >= min)) return HIST_NO_BIN;
+
+    double bin_width = (max - min) / (double)bin_count;
+    if (bin_width == 0.0) return x == min ? 0 : HIST_NO_BIN;
+
+    double q = (x - min) / bin_width;
+    size_t j = q >= (double)bin_count ? bin_count - 1 : (size_t)q;
+
+    // Division may round across an edge, settle on the bin whose edges,
+    // computed as below, contain x with the upper edge exclusive
+    while (j > 0 && min + bin_width * (double)j > x) j--;
+    while (j < bin_count - 1 && x >= min + bin_width * (double)(j + 1)) j++;
+
+    if (x < min + bin_width * (double)j) return HIST_NO_BIN;
+    if (x > min + bin_width * (double)(j + 1)) return HIST_NO_BIN;
+
+    return j;
 }
 
 size_t *
@@ -87,7 +231,6 @@ hist(const double *src, size_t n,
         return NULL;
     }
 
-    if (min == max) bin_count = 1;
     if (min > max) {
         max = max + min;
         min = max - min;
@@ -95,161 +238,1023 @@ hist(const double *src, size_t n,
     }
 
     size_t hist_size = sizeof(size_t) * bin_count;
-    size_t *result = (size_t *)malloc(hist_size);
+    size_t *result = (size_t *)alloc_block(hist_size);
+    if (!result) return NULL;
     memset(result, 0, hist_size);
 
-    double bin_width = (max - min) / (double)bin_count;
-    for (size_t i = 0; i < n; i++) {
-        for (size_t j = 0; j < bin_count; j++) {
-            double lower = min + bin_width * (double)j;
-            if (lower > src[i]) continue;
-
-            double upper = min + bin_width * (double)(j + 1);
-            if (src[i] > upper) continue;
-            if (src[i] == upper && j != bin_count - 1) continue;
-
-            result[j]++;
-        }
-    }
+    hist_run_kernel(hist_select_kernel(src, n, min, max, bin_count),
+            src, n, min, max, bin_count, result);
 
     return result;
 }
 
 size_t *
-hist_from_file(const char *filename, size_t n,
+hist_from_file(const char *filename,
         double min, double max, size_t bin_count) {
-    size_t number_count = 0;
-    double *numbers = numbers_from_file(filename, n, &number_count);
+    size_t number_count = 0, size = 0;
+    double *numbers = numbers_from_file(filename, &number_count, &size);
     if (!numbers) return NULL;
 
     size_t *h = hist(numbers, number_count, min, max, bin_count);
-    safe_free(numbers, sizeof(double) * number_count);
+    free_block(numbers, size);
 
     return h;
 }
 
+static int
+write_all(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+
+    while (len > 0) {
+        ssize_t written = write(fd, p, len);
+        if (written == -1) {
+            perror("write");
+            return 1;
+        }
+        p += written;
+        len -= (size_t)written;
+    }
+
+    return 0;
+}
+
+int
+text_writer_open(struct text_writer *w, const char *filename,
+        size_t line_count) {
+    if (!w || !filename) return 1;
+
+    w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (w->fd == -1) {
+        perror("open");
+        return 1;
+    }
+
+    // Small outputs are formatted whole and written at once
+    w->size = line_count * TEXT_LINE_MAX + TEXT_LINE_MAX;
+    if (w->size > TEXT_WRITER_SIZE) w->size = TEXT_WRITER_SIZE;
+    w->len = 0;
+    w->buf = (char *)alloc_block(w->size);
+    if (!w->buf) {
+        close(w->fd);
+        return 1;
+    }
+
+    return 0;
+}
+
+static char *
+format_ulong(char *p, size_t x) {
+    char digits[20];
+    int k = 0;
+
+    do {
+        digits[k++] = (char)('0' + x % 10);
+        x /= 10;
+    } while (x);
+
+    while (k) *p++ = digits[--k];
+
+    return p;
+}
+
+int
+text_writer_line(struct text_writer *w, size_t bin, size_t count,
+        int write_bin_number) {
+    if (w->size - w->len < TEXT_LINE_MAX) {
+        if (write_all(w->fd, w->buf, w->len) != 0) return 1;
+        w->len = 0;
+    }
+
+    char *p = w->buf + w->len;
+    if (write_bin_number) {
+        p = format_ulong(p, bin);
+        *p++ = ':';
+        *p++ = ' ';
+    }
+    p = format_ulong(p, count);
+    *p++ = '\n';
+    w->len = (size_t)(p - w->buf);
+
+    return 0;
+}
+
+int
+text_writer_cell(struct text_writer *w, size_t xbin, size_t ybin,
+        size_t count) {
+    // Two bin numbers take no more room than two histogram lines
+    if (w->size - w->len < 2 * TEXT_LINE_MAX) {
+        if (write_all(w->fd, w->buf, w->len) != 0) return 1;
+        w->len = 0;
+    }
+
+    char *p = w->buf + w->len;
+    p = format_ulong(p, xbin);
+    *p++ = ' ';
+    p = format_ulong(p, ybin);
+    *p++ = ':';
+    *p++ = ' ';
+    p = format_ulong(p, count);
+    *p++ = '\n';
+    w->len = (size_t)(p - w->buf);
+
+    return 0;
+}
+
+int
+text_writer_text(struct text_writer *w, const char *text) {
+    size_t len = strlen(text);
+
+    if (w->size - w->len < len) {
+        if (write_all(w->fd, w->buf, w->len) != 0) return 1;
+        w->len = 0;
+    }
+
+    // Text longer than the whole buffer bypasses it
+    if (w->size < len) return write_all(w->fd, text, len);
+
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+
+    return 0;
+}
+
+int
+text_writer_close(struct text_writer *w) {
+    int result = write_all(w->fd, w->buf, w->len);
+
+    free_block(w->buf, w->size);
+    if (close(w->fd) == -1) {
+        perror("close");
+        result = 1;
+    }
+
+    return result;
+}
+
 int
 save_hist_to_file(const size_t *h, size_t n,
         const char *filename, int write_bin_numbers) {
     if (!h || !filename) return 1;
 
-    FILE *fhist = fopen(filename, "w");
-    if (!fhist) {
-        perror("fopen");
+    struct text_writer w;
+    if (text_writer_open(&w, filename, n) != 0) return 1;
+
+    int result = 0;
+    for (size_t i = 0; i < n && result == 0; i++) {
+        result = text_writer_line(&w, i + 1, h[i], write_bin_numbers);
+    }
+
+    if (text_writer_close(&w) != 0) result = 1;
+
+    return result;
+}
+
+int
+hist_file_is_binary(const char *filename) {
+    if (!filename) return 0;
+
+    size_t len = strlen(filename);
+    size_t ext_len = strlen(HIST_BINARY_EXT);
+
+    return len >= ext_len &&
+        strcmp(filename + len - ext_len, HIST_BINARY_EXT) == 0;
+}
+
+int
+save_hist_to_binary_file(const size_t *h, size_t n,
+        double min, double max, const char *filename) {
+    return save_counts_to_binary_file(HIST_BIN_MAGIC, h, n, n,
+            min, max, filename);
+}
+
+int
+save_hist(const size_t *h, size_t n, double min, double max,
+        const char *filename, int write_bin_numbers) {
+    if (hist_file_is_binary(filename))
+        return save_hist_to_binary_file(h, n, min, max, filename);
+
+    return save_hist_to_file(h, n, filename, write_bin_numbers);
+}
+
+int
+save_counts_to_binary_file(uint32_t magic, const size_t *counts,
+        size_t count_len, size_t n, double min, double max,
+        const char *filename) {
+    if (!counts || !filename) return 1;
+
+    struct hist_bin_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = magic;
+    header.version = HIST_BIN_VERSION;
+    header.bin_count = n;
+    header.min = min < max ? min : max;
+    header.max = min < max ? max : min;
+
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        perror("open");
         return 1;
     }
 
-    for (size_t i = 0; i < n; i++) {
-        if (write_bin_numbers)
-            fprintf(fhist, "%lu: %lu\n", i + 1, h[i]);
-        else
-            fprintf(fhist, "%lu\n", h[i]);
+    int result = write_all(fd, &header, sizeof(header));
+    if (result == 0)
+        result = write_all(fd, counts, sizeof(size_t) * count_len);
+
+    if (close(fd) == -1) {
+        perror("close");
+        result = 1;
+    }
+
+    return result;
+}
+
+/// Map a whole file read-only
+static int
+map_file(const char *filename, void **addr, size_t *size) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        return 1;
     }
 
-    fclose(fhist);
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return 1;
+    }
+
+    *size = (size_t)st.st_size;
+    if (*size < sizeof(struct hist_bin_header)) {
+        ERROR("map_hist_file", "not a binary histogram file");
+        close(fd);
+        return 1;
+    }
+
+    *addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*addr == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    madvise(*addr, *size, MADV_SEQUENTIAL);
 
     return 0;
 }
 
+/// Check a mapped file of pairs and find its (bin, value) pairs
+static int
+file_pairs(const void *addr, size_t size, uint32_t magic,
+        const size_t **pairs, size_t *pair_count) {
+    const struct hist_bin_header *header = addr;
+    size_t len = size - sizeof(*header);
+
+    if (header->magic != magic || header->version != HIST_BIN_VERSION ||
+            len % (2 * sizeof(size_t)) != 0) {
+        ERROR("map_hist_file", "not a binary histogram file");
+        return 1;
+    }
+
+    *pairs = (const size_t *)(header + 1);
+    *pair_count = len / (2 * sizeof(size_t));
+
+    // Bins increase strictly, so pairs can be searched
+    for (size_t i = 0; i < *pair_count; i++) {
+        if ((*pairs)[2 * i] >= header->bin_count ||
+                (i > 0 && (*pairs)[2 * i] <= (*pairs)[2 * i - 2])) {
+            ERROR("map_hist_file", "bins out of range or order in sparse file");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+map_pairs_file(const char *filename, uint32_t magic, struct hist_map *map,
+        size_t *pair_count) {
+    if (!filename || !map || !pair_count) return 1;
+
+    if (map_file(filename, &map->addr, &map->size) != 0) {
+        map->addr = NULL;
+        return 1;
+    }
+
+    map->header = (const struct hist_bin_header *)map->addr;
+    if (file_pairs(map->addr, map->size, magic, &map->counts,
+                pair_count) != 0) {
+        unmap_hist_file(map);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+map_sparse_hist_file(const char *filename, struct hist_map *map) {
+    void *addr;
+    size_t size;
+    if (map_file(filename, &addr, &size) != 0) return 1;
+
+    const struct hist_bin_header *header = addr;
+    const size_t *pairs;
+    size_t pair_count;
+    if (file_pairs(addr, size, HIST_SPARSE_MAGIC, &pairs, &pair_count) != 0) {
+        munmap(addr, size);
+        return 1;
+    }
+
+    map->size = sizeof(*header) + sizeof(size_t) * header->bin_count;
+    map->addr = mmap(NULL, map->size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map->addr == MAP_FAILED) {
+        perror("mmap");
+        munmap(addr, size);
+        map->addr = NULL;
+        return 1;
+    }
+
+    struct hist_bin_header *dense = (struct hist_bin_header *)map->addr;
+    size_t *counts = (size_t *)(dense + 1);
+    memcpy(dense, header, sizeof(*dense));
+    dense->magic = HIST_BIN_MAGIC;
+
+    for (size_t i = 0; i < pair_count; i++) {
+        counts[pairs[2 * i]] += pairs[2 * i + 1];
+    }
+
+    munmap(addr, size);
+
+    map->header = dense;
+    map->counts = counts;
+
+    return 0;
+}
+
+int
+map_hist_file(const char *filename, struct hist_map *map) {
+    struct hist_bin_header header;
+    if (read_hist_header(filename, &header) == 0 &&
+            header.magic == HIST_SPARSE_MAGIC)
+        return map_sparse_hist_file(filename, map);
+
+    return map_counts_file(filename, HIST_BIN_MAGIC, 0, map);
+}
+
+int
+map_counts_file(const char *filename, uint32_t magic, size_t extra_counts,
+        struct hist_map *map) {
+    if (!filename || !map) return 1;
+
+    if (map_file(filename, &map->addr, &map->size) != 0) {
+        map->addr = NULL;
+        return 1;
+    }
+
+    map->header = (const struct hist_bin_header *)map->addr;
+    map->counts = (const size_t *)(map->header + 1);
+
+    if (map->header->magic != magic ||
+            map->header->version != HIST_BIN_VERSION ||
+            map->size != sizeof(struct hist_bin_header) +
+                sizeof(size_t) * (map->header->bin_count + extra_counts)) {
+        ERROR("map_hist_file", "not a binary histogram file");
+        unmap_hist_file(map);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+unmap_hist_file(struct hist_map *map) {
+    if (!map || !map->addr) return;
+
+    if (munmap(map->addr, map->size) == -1)
+        perror("munmap");
+    map->addr = NULL;
+}
+
 int
-hist_from_file_to_file(const char *ifname, size_t n,
+hist_from_file_to_file(const char *ifname,
         double min, double max, size_t bin_count,
         const char *ofname) {
+    size_t number_count = 0, size = 0;
+    double *numbers = numbers_from_file(ifname, &number_count, &size);
+    if (!numbers) return 1;
+
+    int result = 1;
+    if (hist_should_be_sparse(number_count, bin_count)) {
+        struct sparse_hist *sh = sparse_hist(numbers, number_count,
+                min, max, bin_count);
+        if (sh) {
+            result = save_sparse_hist(sh, min, max, ofname);
+            sparse_hist_destroy(sh);
+        }
+    } else {
+        size_t *h = hist(numbers, number_count, min, max, bin_count);
+        if (h) {
+            result = save_hist(h, bin_count, min, max, ofname, 0);
+            free_block(h, sizeof(size_t) * bin_count);
+        }
+    }
+
+    free_block(numbers, size);
+
+    return result;
+}
+
+int
+read_hist_header(const char *filename, struct hist_bin_header *header) {
+    if (!filename || !header) return 1;
+
+    FILE *f = fopen(filename, "r");
+    if (!f) return 1;
+
+    int result = fread(header, sizeof(*header), 1, f) != 1 ||
+        (header->magic != HIST_BIN_MAGIC &&
+         header->magic != HIST_SPARSE_MAGIC);
+
+    fclose(f);
+
+    return result;
+}
+
+int
+read_hist_edges(const char *filename, struct hist_bin_header *header) {
+    if (!filename || !header) return 1;
+    if (read_hist_header(filename, header) == 0) {
+        header->magic = HIST_BIN_MAGIC;
+        return 0;
+    }
+
+    FILE *f = fopen(filename, "r");
+    if (!f) return 1;
+
+    unsigned long bin_count;
+    int result = fgetc(f) != HIST_SPARSE_MARK ||
+        fscanf(f, "%lu %lf %lf", &bin_count, &header->min,
+                &header->max) != 3;
+    fclose(f);
+
+    if (result == 0) {
+        header->magic = HIST_BIN_MAGIC;
+        header->version = HIST_BIN_VERSION;
+        header->bin_count = bin_count;
+    }
+
+    return result;
+}
+
+static int
+read_sparse_binary_file(const char *filename, size_t bin_count,
+        hist_bin_fn add, void *ctx) {
+    void *addr;
+    size_t size;
+    if (map_file(filename, &addr, &size) != 0) return 1;
+
+    const struct hist_bin_header *header = addr;
+    const size_t *pairs;
+    size_t pair_count;
+    int result = file_pairs(addr, size, HIST_SPARSE_MAGIC, &pairs, &pair_count);
+
+    if (result == 0 && header->bin_count != bin_count) {
+        fprintf(stderr, "read_hist_file: %s: file has %lu bins, "
+                "expected %lu\n", filename, header->bin_count, bin_count);
+        result = 1;
+    }
+
+    for (size_t i = 0; result == 0 && i < pair_count; i++) {
+        if (pairs[2 * i + 1]) add(ctx, pairs[2 * i], pairs[2 * i + 1]);
+    }
+
+    munmap(addr, size);
+
+    return result;
+}
+
+static int
+read_hist_binary_file(const char *filename, size_t bin_count,
+        hist_bin_fn add, void *ctx) {
+    struct hist_map map;
+    if (map_hist_file(filename, &map) != 0) return 1;
+
+    if (map.header->bin_count != bin_count) {
+        fprintf(stderr, "read_hist_file: %s: file has %lu bins, "
+                "expected %lu\n", filename, map.header->bin_count, bin_count);
+        unmap_hist_file(&map);
+        return 1;
+    }
+
+    for (size_t i = 0; i < map.header->bin_count; i++) {
+        if (map.counts[i]) add(ctx, i, map.counts[i]);
+    }
+
+    unmap_hist_file(&map);
+
+    return 0;
+}
+
+/// Parse a count, rejecting signs, overflow and missing digits
+static int
+parse_count(const char *s, char **end, size_t *count) {
+    while (isspace((unsigned char)*s)) s++;
+    if (!isdigit((unsigned char)*s)) return 1;
+
+    errno = 0;
+    *count = strtoul(s, end, 10);
+
+    return errno == ERANGE;
+}
+
+int
+read_hist_file(const char *filename, size_t bin_count,
+        hist_bin_fn add, void *ctx) {
+    if (!filename || !add) {
+        EINVALID_ARGS("read_hist_file");
+        return 1;
+    }
+
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        perror("fopen");
+        return 1;
+    }
+
+    unsigned int magic = 0;
+    if (fread(&magic, sizeof(magic), 1, f) == 1 && magic == HIST_BIN_MAGIC) {
+        fclose(f);
+        return read_hist_binary_file(filename, bin_count, add, ctx);
+    }
+    if (magic == HIST_SPARSE_MAGIC) {
+        fclose(f);
+        return read_sparse_binary_file(filename, bin_count, add, ctx);
+    }
+    rewind(f);
+
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t index = 0;
+    int numbered = 0;
+    int sparse = 0;
     int result = 0;
 
-    size_t *h = hist_from_file(ifname, n, min, max, bin_count);
-    if (!h) return 1;
+    while (getline(&line, &line_size, f) != -1) {
+        if (line[0] == '\n') continue;
+
+        // Sparse files start with their bin count and edges
+        if (line[0] == HIST_SPARSE_MARK && index == 0) {
+            size_t file_bins = 0;
+            if (sscanf(line + 1, "%lu", &file_bins) != 1) {
+                fprintf(stderr, "read_hist_file: %s: malformed header\n",
+                        filename);
+                result = 1;
+                break;
+            }
+            if (file_bins != bin_count) {
+                fprintf(stderr, "read_hist_file: %s: file has %lu bins, "
+                        "expected %lu\n", filename, file_bins, bin_count);
+                result = 1;
+                break;
+            }
+            sparse = 1;
+            continue;
+        }
+
+        char *end;
+        size_t bin = index++;
+        size_t count;
+        int line_numbered = 0;
+        int valid = parse_count(line, &end, &count) == 0;
+
+        // Lines with bin numbers are "<bin>: <count>", bins start at 1
+        if (valid && *end == ':') {
+            line_numbered = 1;
+            bin = count - 1;
+            valid = count > 0 && parse_count(end + 1, &end, &count) == 0;
+        }
+
+        if (!valid || !(*end == '\0' || isspace((unsigned char)*end)) ||
+                (index > 1 && line_numbered != numbered) ||
+                (sparse && !line_numbered)) {
+            fprintf(stderr, "read_hist_file: %s: malformed line %lu\n",
+                    filename, index);
+            result = 1;
+            break;
+        }
+        numbered = line_numbered;
 
-    result = save_hist_to_file(h, bin_count, ofname, 0);
-    safe_free(h, sizeof(size_t) * bin_count);
+        if (bin >= bin_count) {
+            fprintf(stderr, "read_hist_file: %s: bin %lu exceeds "
+                    "bin count %lu\n", filename, bin + 1, bin_count);
+            result = 1;
+            break;
+        }
+
+        if (count) add(ctx, bin, count);
+    }
+
+    // Files without a sparse header have a line for every bin
+    if (result == 0 && !sparse && index != bin_count) {
+        fprintf(stderr, "read_hist_file: %s: file has %lu bins, "
+                "expected %lu\n", filename, index, bin_count);
+        result = 1;
+    }
+
+    free(line);
+    fclose(f);
 
     return result;
 }
 
+void
+set_partial_hist_format(int binary) {
+    partial_hist_ext = binary ? HIST_BINARY_EXT : HIST_TEXT_EXT;
+}
+
+char *
+hist_file_name(const char *filename_prefix, size_t index) {
+    char *fname = NULL;
+
+    if (asprintf(&fname, "%s%lu%s", filename_prefix, index,
+                partial_hist_ext) == -1) {
+        perror("asprintf");
+        return NULL;
+    }
+
+    return fname;
+}
+
+static void
+dense_add(void *ctx, size_t bin, size_t count) {
+    ((size_t *)ctx)[bin] += count;
+}
+
+void
+hist_tree_reduce(size_t **partials, size_t thread_num, size_t thread_count,
+        size_t len, pthread_barrier_t *barrier) {
+    size_t *partial = partials[thread_num];
+
+    // Partial of thread t + step is added into thread t
+    for (size_t step = 1; step < thread_count; step *= 2) {
+        pthread_barrier_wait(barrier);
+
+        if (thread_num % (2 * step) != 0) continue;
+        if (thread_num + step >= thread_count) continue;
+
+        size_t *other = partials[thread_num + step];
+        for (size_t j = 0; j < len; j++) {
+            partial[j] += other[j];
+        }
+    }
+}
+
+struct merge_info {
+    size_t                          bin_count;
+    const char *const               *filenames;
+    size_t                          file_count;
+    size_t                          next_file;
+    size_t                          thread_count;
+    size_t                          **partials;
+    struct sparse_hist              **sparse_partials;
+    const struct hist_bin_header    *edges;
+    pthread_mutex_t                 start;
+    pthread_barrier_t               barrier;
+    int                             reduce;
+    int                             failed;
+};
+
+struct merge_thread_info {
+    pthread_t           thread_id;
+    size_t              thread_num;
+    struct merge_info   *minfo;
+};
+
+static void
+sparse_merge_add(void *ctx, size_t bin, size_t count) {
+    struct merge_info *minfo = ((struct merge_thread_info *)ctx)->minfo;
+    size_t t = ((struct merge_thread_info *)ctx)->thread_num;
+
+    if (sparse_hist_add(minfo->sparse_partials[t], bin, count) != 0)
+        __atomic_store_n(&minfo->failed, 1, __ATOMIC_RELAXED);
+}
+
+static int
+merge_one_file(struct merge_thread_info *tinfo, const char *filename) {
+    struct merge_info *minfo = tinfo->minfo;
+    struct hist_bin_header header;
+
+    // Only binary and sparse files carry edges to verify
+    if (minfo->edges && read_hist_edges(filename, &header) == 0 &&
+            (header.min != minfo->edges->min ||
+             header.max != minfo->edges->max)) {
+        fprintf(stderr, "merge_hist_file_list: %s: bin edges differ "
+                "from other histograms\n", filename);
+        return 1;
+    }
+
+    if (minfo->sparse_partials)
+        return read_hist_file(filename, minfo->bin_count,
+                &sparse_merge_add, tinfo);
+
+    return read_hist_file(filename, minfo->bin_count, &dense_add,
+            minfo->partials[tinfo->thread_num]);
+}
+
+static void *
+merge_thread_function(void *arg) {
+    struct merge_thread_info *tinfo = arg;
+    struct merge_info *minfo = tinfo->minfo;
+
+    // Files are handed out one at a time as their sizes vary
+    for (;;) {
+        size_t i = __atomic_fetch_add(&minfo->next_file, 1, __ATOMIC_RELAXED);
+        if (i >= minfo->file_count) break;
+        if (__atomic_load_n(&minfo->failed, __ATOMIC_RELAXED)) break;
+
+        if (merge_one_file(tinfo, minfo->filenames[i]) != 0)
+            __atomic_store_n(&minfo->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    // The barrier is set up once it is known how many threads started
+    pthread_mutex_lock(&minfo->start);
+    pthread_mutex_unlock(&minfo->start);
+
+    if (minfo->reduce)
+        hist_tree_reduce(minfo->partials, tinfo->thread_num,
+                minfo->thread_count, minfo->bin_count, &minfo->barrier);
+
+    return NULL;
+}
+
+int
+hist_file_is_sparse(const char *filename) {
+    struct hist_bin_header header;
+    if (read_hist_header(filename, &header) == 0)
+        return header.magic == HIST_SPARSE_MAGIC;
+
+    FILE *f = fopen(filename, "r");
+    if (!f) return 0;
+
+    int result = fgetc(f) == HIST_SPARSE_MARK;
+    fclose(f);
+
+    return result;
+}
+
+/// Merge files into dest, or into sparse_dest if dest is NULL
+static int
+merge_file_list(size_t dest[], struct sparse_hist *sparse_dest,
+        size_t bin_count, const char *const *filenames, size_t file_count,
+        size_t thread_count, struct hist_bin_header *edges) {
+
+    if (file_count == 0) return 0;
+    if (thread_count == 0) thread_count = 1;
+    if (thread_count > file_count) thread_count = file_count;
+
+    // Take reference edges from the first file recording them if none
+    // are given
+    if (edges && edges->magic != HIST_BIN_MAGIC) {
+        for (size_t i = 0; i < file_count; i++) {
+            if (read_hist_edges(filenames[i], edges) == 0) break;
+            edges->magic = 0;
+        }
+        if (edges->magic != HIST_BIN_MAGIC) edges = NULL;
+    }
+
+    // Sparse inputs are summed into sparse partials, dense partials of
+    // many bins would take thread_count times the memory of dest
+    int sparse = 1;
+    for (size_t i = 0; i < file_count && sparse && !sparse_dest; i++) {
+        sparse = hist_file_is_sparse(filenames[i]);
+    }
+
+    struct merge_info minfo;
+    memset(&minfo, 0, sizeof(minfo));
+    minfo.bin_count = bin_count;
+    minfo.filenames = filenames;
+    minfo.file_count = file_count;
+    minfo.edges = edges;
+
+    size_t partial_size = sizeof(size_t) * bin_count;
+    struct merge_thread_info *tinfo = calloc(thread_count, sizeof(*tinfo));
+    minfo.partials = calloc(thread_count, sizeof(size_t *));
+    if (sparse)
+        minfo.sparse_partials = calloc(thread_count,
+                sizeof(struct sparse_hist *));
+    if (!tinfo || !minfo.partials || (sparse && !minfo.sparse_partials)) {
+        perror("calloc");
+        free(tinfo);
+        free(minfo.partials);
+        free(minfo.sparse_partials);
+        return 1;
+    }
+
+    int result = 0;
+    for (size_t t = 0; t < thread_count; t++) {
+        if (sparse)
+            minfo.sparse_partials[t] = sparse_hist_create(bin_count);
+        else
+            minfo.partials[t] = (size_t *)alloc_block(partial_size);
+
+        if (sparse ? !minfo.sparse_partials[t] : !minfo.partials[t]) {
+            result = 1;
+            goto cleanup;
+        }
+        if (!sparse) memset(minfo.partials[t], 0, partial_size);
+    }
+
+    pthread_mutex_init(&minfo.start, NULL);
+    pthread_mutex_lock(&minfo.start);
+
+    size_t started = 0;
+    for (; started < thread_count; started++) {
+        tinfo[started].thread_num = started;
+        tinfo[started].minfo = &minfo;
+
+        int err = pthread_create(&tinfo[started].thread_id, NULL,
+                &merge_thread_function, &tinfo[started]);
+        if (err != 0) {
+            errno = err;
+            perror("pthread_create");
+            break;
+        }
+    }
+
+    // Threads that did start take all files, and reduce among themselves
+    minfo.thread_count = started;
+    if (started == 0) {
+        result = 1;
+    } else if (!sparse) {
+        if (pthread_barrier_init(&minfo.barrier, NULL,
+                    (unsigned int)started) == 0) {
+            minfo.reduce = 1;
+        } else {
+            perror("pthread_barrier_init");
+            result = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&minfo.start);
+
+    for (size_t t = 0; t < started; t++) {
+        if (pthread_join(tinfo[t].thread_id, NULL) != 0) {
+            perror("pthread_join");
+            result = 1;
+        }
+    }
+
+    if (minfo.reduce) pthread_barrier_destroy(&minfo.barrier);
+    pthread_mutex_destroy(&minfo.start);
+
+    if (minfo.failed) result = 1;
+    if (result == 0 && sparse_dest) {
+        for (size_t t = 0; t < started && result == 0; t++) {
+            result = sparse_hist_merge(sparse_dest, minfo.sparse_partials[t]);
+        }
+    } else if (result == 0 && sparse) {
+        for (size_t t = 0; t < started; t++) {
+            sparse_hist_add_to(minfo.sparse_partials[t], dest);
+        }
+    } else if (result == 0) {
+        for (size_t j = 0; j < bin_count; j++) {
+            dest[j] += minfo.partials[0][j];
+        }
+    }
+
+cleanup:
+    for (size_t t = 0; t < thread_count; t++) {
+        if (sparse)
+            sparse_hist_destroy(minfo.sparse_partials[t]);
+        else
+            free_block(minfo.partials[t], partial_size);
+    }
+    free(minfo.sparse_partials);
+    safe_free(minfo.partials, sizeof(size_t *) * thread_count);
+    safe_free(tinfo, sizeof(*tinfo) * thread_count);
+
+    return result;
+}
+
+int
+merge_hist_file_list(size_t dest[], size_t bin_count,
+        const char *const *filenames, size_t file_count,
+        size_t thread_count, struct hist_bin_header *edges) {
+    if (!dest || !filenames || bin_count == 0) {
+        EINVALID_ARGS("merge_hist_file_list");
+        return 1;
+    }
+
+    return merge_file_list(dest, NULL, bin_count, filenames, file_count,
+            thread_count, edges);
+}
+
+int
+merge_sparse_hist_file_list(struct sparse_hist *dest,
+        const char *const *filenames, size_t file_count,
+        size_t thread_count, struct hist_bin_header *edges) {
+    if (!dest || !filenames) {
+        EINVALID_ARGS("merge_sparse_hist_file_list");
+        return 1;
+    }
+
+    return merge_file_list(NULL, dest, dest->bin_count, filenames, file_count,
+            thread_count, edges);
+}
+
 int
 merge_hist_files(size_t dest[], size_t bin_count,
         const char *filename_prefix, size_t hist_count) {
     if (!dest) return 1;
     if (!filename_prefix) return 1;
 
-    char fname[256];
-    double *h = NULL;
-    size_t hist_length = 0;
-    size_t lines;
+    char **fnames = calloc(hist_count + 1, sizeof(char *));
+    if (!fnames) {
+        perror("calloc");
+        return 1;
+    }
 
+    int result = 0;
     for (size_t i = 0; i < hist_count; i++) {
-        snprintf(fname, 256, "%s%lu.txt", filename_prefix, i + 1);
-        lines = line_count(fname);
-        h = numbers_from_file(fname, lines, &hist_length);
-        if (!h) goto next;
-
-        if (hist_length > bin_count) {
-            ERROR("merge_hist_files", "number of bins in histogram file"
-                                        "exceeds given bin count");
-            goto next;
+        fnames[i] = hist_file_name(filename_prefix, i + 1);
+        if (!fnames[i]) {
+            result = 1;
+            break;
         }
+    }
 
-        for (size_t j = 0; j < bin_count; j++) {
-            if (j < hist_length)
-                dest[j] += (size_t)h[j];
-            else
-                dest[j] += 0;
-        }
+    if (result == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        result = merge_hist_file_list(dest, bin_count,
+                (const char *const *)fnames, hist_count,
+                cpus > 0 ? (size_t)cpus : 1, NULL);
+    }
 
-next:
-        safe_free(h, sizeof(double) * hist_length);
+    for (size_t i = 0; i < hist_count; i++) {
+        free(fnames[i]);
     }
+    safe_free(fnames, sizeof(char *) * (hist_count + 1));
 
-    return 0;
+    return result;
+}
+
+static size_t
+shm_map_size(size_t shm_size) {
+    return huge_pages ? huge_round(shm_size) : shm_size;
+}
+
+int
+open_shm(const char *shm_name, int oflag, mode_t mode) {
+    if (!shm_name) return -1;
+    if (!hugetlbfs_dir) return shm_open(shm_name, oflag, mode);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", hugetlbfs_dir,
+            shm_name[0] == '/' ? shm_name + 1 : shm_name);
+
+    return open(path, oflag, mode);
+}
+
+int
+unlink_shm(const char *shm_name) {
+    if (!shm_name) return -1;
+    if (!hugetlbfs_dir) return shm_unlink(shm_name);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", hugetlbfs_dir,
+            shm_name[0] == '/' ? shm_name + 1 : shm_name);
+
+    return unlink(path);
 }
 
 int
 create_shm(const char *shm_name, size_t shm_size) {
     int fd;
-    void *shmp;
 
     if (!shm_name || shm_size == 0) return -1;
 
     // Open or create shared memory
-    fd = shm_open(shm_name, O_CREAT | O_RDWR | O_EXCL,
+    fd = open_shm(shm_name, O_CREAT | O_RDWR | O_EXCL,
             S_IRUSR | S_IWUSR);
     if (fd == -1) {
         perror("shm_open");
         return -1;
     }
 
-    // Allocate memory
-    if (ftruncate(fd, shm_size) == -1) {
+    // Allocate memory. ftruncate zero-fills, and leaving the pages
+    // untouched lets the first producer of each slice place it on
+    // its own NUMA node.
+    if (ftruncate(fd, shm_map_size(shm_size)) == -1) {
         perror("ftruncate");
         close(fd);
-        shm_unlink(shm_name);
-        return -1;
-    }
-
-    // Fill allocated memory with 0's
-    shmp = mmap(NULL, shm_size,
-            PROT_READ | PROT_WRITE,
-            MAP_SHARED, fd, 0);
-    if (shmp == MAP_FAILED) {
-        perror("mmap");
-        close(fd);
-        shm_unlink(shm_name);
-        return -1;
-    }
-
-    memset(shmp, 0, shm_size);
-
-    // Cleanup
-    if (munmap(shmp, shm_size) == -1) {
-        perror("munmap");
-        close(fd);
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return -1;
     }
 
     if (close(fd) == -1) {
         perror("close");
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return -1;
     }
 
@@ -260,22 +1265,26 @@ void *
 get_shm(const char *shm_name, size_t shm_size, int *fd) {
     if (!shm_name || shm_size == 0 || !fd) return NULL;
 
-    if ((*fd = shm_open(shm_name, O_RDWR, 0)) == -1) {
+    if ((*fd = open_shm(shm_name, O_RDWR, 0)) == -1) {
         perror("shm_open");
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return NULL;
     }
 
-    void *shmp = mmap(NULL, shm_size,
+    void *shmp = mmap(NULL, shm_map_size(shm_size),
             PROT_READ | PROT_WRITE,
             MAP_SHARED, *fd, 0);
     if (shmp == MAP_FAILED) {
         perror("mmap");
         close(*fd);
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return NULL;
     }
 
+    // Without a hugetlbfs mount, ask for transparent huge pages
+    if (huge_pages && !hugetlbfs_dir)
+        madvise(shmp, shm_map_size(shm_size), MADV_HUGEPAGE);
+
     return shmp;
 }
 
@@ -283,16 +1292,16 @@ int
 cleanup_shm(void *shmp, const char *shm_name, size_t shm_size, int fd) {
     if (!shmp || shm_size == 0 || fd < 0) return -1;
 
-    if (munmap(shmp, shm_size) == -1) {
+    if (munmap(shmp, shm_map_size(shm_size)) == -1) {
         perror("munmap");
         close(fd);
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return -1;
     }
 
     if (close(fd) == -1) {
         perror("close");
-        shm_unlink(shm_name);
+        unlink_shm(shm_name);
         return -1;
     }
 
@@ -318,6 +1327,24 @@ create_sem(const char *sem_name) {
     return 0;
 }
 
+int
+reuse_sem(const char *sem_name) {
+    if (!sem_name) return -1;
+
+    sem_t *sem = sem_open(sem_name, O_CREAT, 0644, 1);
+    if (sem == SEM_FAILED) {
+        perror("sem_open");
+        return -1;
+    }
+
+    if (sem_close(sem) == -1) {
+        perror("sem_close");
+        return -1;
+    }
+
+    return 0;
+}
+
 sem_t *
 open_wait_sem(const char *sem_name) {
     if (!sem_name) return NULL;
@@ -359,10 +1386,114 @@ post_close_sem(sem_t *sem, const char *sem_name) {
     return 0;
 }
 
+/// Options of the histogram programs, with the argument they take
+static const struct {
+    char        letter;
+    const char  *arg;
+    const char  *help;
+} hist_option_list[] = {
+    { 'H', NULL, "Back large buffers and shared memory with huge pages" },
+    { 'T', "HUGETLBFS",
+        "Place shared memory on the hugetlbfs mounted at HUGETLBFS" },
+    { 'N', NULL, "Pin workers to NUMA nodes" },
+    { 'B', NULL, "Write partial histograms in binary format" },
+    { 'R', "BASEFILE",
+        "Derive OFILE from the binary histogram BASEFILE if it is aligned,"
+        " rescan otherwise" },
+    { 'I', NULL, "Write cumulative counts of OFILE to OFILE.idx" },
+    { 'L', NULL, "Keep the shared histogram after exit and add into a"
+        " kept one" },
+};
+
+#define HIST_OPTION_COUNT \
+    (sizeof(hist_option_list) / sizeof(hist_option_list[0]))
+
+int
+parse_options(int argc, char **argv, const char *supported,
+        struct hist_options *opts) {
+    if (!argv || !supported || !opts) return -1;
+
+    memset(opts, 0, sizeof(*opts));
+
+    // Options are matched exactly so a negative MINVAL is not taken
+    // for one
+    int i = 1;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+
+        char letter = 0;
+        for (size_t k = 0; k < HIST_OPTION_COUNT; k++) {
+            if (argv[i][0] == '-' && argv[i][1] == hist_option_list[k].letter
+                    && argv[i][2] == '\0')
+                letter = hist_option_list[k].letter;
+        }
+        if (!letter) break;
+
+        if (!strchr(supported, letter)) {
+            fprintf(stderr, "%s: option %s is not supported\n",
+                    argv[0], argv[i]);
+            return -1;
+        }
+
+        switch (letter) {
+        case 'H':
+            opts->huge_pages = 1;
+            break;
+        case 'T':
+            if (++i == argc) return -1;
+            opts->huge_pages = 1;
+            opts->hugetlbfs_dir = argv[i];
+            break;
+        case 'N':
+            opts->numa = 1;
+            break;
+        case 'B':
+            opts->binary = 1;
+            break;
+        case 'L':
+            opts->live = 1;
+            break;
+        case 'I':
+            opts->index = 1;
+            break;
+        case 'R':
+            if (++i == argc) return -1;
+            opts->base_file = argv[i];
+            break;
+        }
+    }
+
+    set_huge_pages(opts->huge_pages, opts->hugetlbfs_dir);
+    set_partial_hist_format(opts->binary);
+    opts->node_count = opts->numa ? numa_node_count() : 1;
+
+    return i;
+}
+
 void
-print_usage(const char *prog) {
-    if (!prog) return;
+print_usage(const char *prog, const char *supported) {
+    if (!prog || !supported) return;
     printf("Usage:\n");
-    printf("\t%s [MINVAL] [MAXVAL] [BINCOUNT]"
-           " [FILECOUNT] [IFILE]... [OFILE]", prog);
+    printf("\t%s", prog);
+    for (size_t k = 0; k < HIST_OPTION_COUNT; k++) {
+        if (!strchr(supported, hist_option_list[k].letter)) continue;
+
+        if (hist_option_list[k].arg)
+            printf(" [-%c %s]", hist_option_list[k].letter,
+                    hist_option_list[k].arg);
+        else
+            printf(" [-%c]", hist_option_list[k].letter);
+    }
+    printf(" [MINVAL] [MAXVAL] [BINCOUNT] [FILECOUNT] [IFILE]... [OFILE]\n");
+
+    for (size_t k = 0; k < HIST_OPTION_COUNT; k++) {
+        if (strchr(supported, hist_option_list[k].letter))
+            printf("\t-%c\t%s\n", hist_option_list[k].letter,
+                    hist_option_list[k].help);
+    }
+    printf("\tOFILE is written in binary format if it ends with "
+           HIST_BINARY_EXT "\n");
 }
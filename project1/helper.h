@@ -1,7 +1,10 @@
 #ifndef PROJECT1_HELPER_H
 #define PROJECT1_HELPER_H
 
+#include <sys/types.h>
+#include <pthread.h>
 #include <semaphore.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -11,14 +14,94 @@
 
 #define EINVALID_ARGS(f) ERROR(f, "invalid arguments supplied")
 
+#define HIST_NO_BIN ((size_t)-1)
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+#define HIST_TEXT_EXT ".txt"
+
+#define HIST_BINARY_EXT ".bin"
+
+/// "HIST" in a little-endian file
+#define HIST_BIN_MAGIC 0x54534948U
+
+/// "HSPR" in a little-endian file
+#define HIST_SPARSE_MAGIC 0x52505348U
+
+#define HIST_BIN_VERSION 1U
+
+/// Size of the buffer text histograms are formatted in before writing
+#define TEXT_WRITER_SIZE (1UL << 20)
+
+/// Most numbers numbers_from_file makes room for before it has to grow
+#define NUMBERS_CHUNK (1UL << 20)
+
+/// Longest line of a text histogram, "<bin>: <count>\n"
+#define TEXT_LINE_MAX 43
+
+/// Starts the first line of a sparse text histogram,
+/// "# <bin_count> <min> <max>"
+#define HIST_SPARSE_MARK '#'
+
+struct sparse_hist;
+
+/// Header of a binary histogram file, followed by bin_count 64-bit
+/// counters. Bin edges are min + (max - min) / bin_count * i as in hist.
+/// A sparse file has HIST_SPARSE_MAGIC and is followed by 64-bit
+/// (bin, count) pairs of non-empty bins in increasing bin order instead.
+struct hist_bin_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    bin_count;
+    double      min;
+    double      max;
+};
+
+/// Binary histogram file mapped into memory
+struct hist_map {
+    void                            *addr;
+    size_t                          size;
+    const struct hist_bin_header    *header;
+    const size_t                    *counts;
+};
+
+/// Buffered writer for text histograms
+struct text_writer {
+    int     fd;
+    char    *buf;
+    size_t  size;
+    size_t  len;
+};
+
+/// Command line options shared by the histogram programs
+struct hist_options {
+    int         huge_pages;
+    const char  *hugetlbfs_dir;
+    int         numa;
+    int         node_count;
+    int         binary;
+    const char  *base_file;
+    int         index;
+    int         live;
+};
+
 
 /// Read file for floating point numbers
 /// \param filename Name of the file to read
-/// \param n Maximum number of floating-point numbers to read
 /// \param read Number of floating-point numbers read
-/// \return A new malloc-ed array containing floating-point numbers read
+/// \param size Size of the returned array, to release it with free_block
+/// \return A new array containing floating-point numbers read
 double *
-numbers_from_file(const char *filename, size_t n, size_t *read);
+numbers_from_file(const char *filename, size_t *read, size_t *size);
+
+/// Find the bin of a number, matching edges used by hist
+/// \param x Number to place
+/// \param min Minimum number, not greater than max
+/// \param max Maximum number
+/// \param bin_count Number of bins
+/// \return Index of the bin, HIST_NO_BIN if x is out of range
+size_t
+hist_bin_index(double x, double min, double max, size_t bin_count);
 
 /// Create a histogram
 /// \param src Source data
@@ -26,16 +109,18 @@ numbers_from_file(const char *filename, size_t n, size_t *read);
 /// \param min Minimum number
 /// \param max Maximum number
 /// \param bin_count Number of bins
-/// \return A new malloc-ed array containing number of items in a bin
+/// \return A new array containing number of items in a bin, released
+///     with free_block as it is mapped if huge pages are enabled
 size_t *
 hist(const double *src, size_t n,
         double min, double max, size_t bin_count);
 
-/// Get number of lines in a file
+/// Estimate an upper bound of the number of numbers in a file
+/// without reading it
 /// \param filename Name of the file
-/// \return Number of lines in the file
+/// \return Upper bound of the number of numbers in the file
 size_t
-line_count(const char *filename);
+estimate_sample_count(const char *filename);
 
 /// Safely free a heap block
 /// \param block Block to free
@@ -43,15 +128,44 @@ line_count(const char *filename);
 void
 safe_free(void *block, size_t size);
 
+/// Enable or disable huge page backing for large blocks and shared memory.
+/// Must be set before any block or shared memory is allocated.
+/// \param enable Non-zero to enable huge pages
+/// \param hugetlbfs Mount point of a hugetlbfs for shared memory, or NULL
+void
+set_huge_pages(int enable, const char *hugetlbfs);
+
+/// Allocate a block, backed by huge pages if enabled and block is large
+/// \param size Size of the block
+/// \return A new block to be released with free_block
+void *
+alloc_block(size_t size);
+
+/// Free a block allocated by alloc_block
+/// \param block Block to free
+/// \param size Size of the block as passed to alloc_block
+void
+free_block(void *block, size_t size);
+
+/// Get number of NUMA nodes in the system
+/// \return Number of nodes, 1 if the system has no NUMA information
+int
+numa_node_count(void);
+
+/// Restrict calling thread to the CPUs of a NUMA node
+/// \param node Node to pin to
+int
+pin_to_numa_node(int node);
+
 /// Create histogram using data in file
 /// \param filename Name of the file to read
-/// \param n Maximum number of numbers to read
 /// \param min Minimum value for histogram
 /// \param max Maximum value for histogram
 /// \param bin_count Number of bins
-/// \return A new malloc-ed array containing histogram data
+/// \return A new array containing histogram data, released with
+///     free_block, see hist
 size_t *
-hist_from_file(const char *filename, size_t n,
+hist_from_file(const char *filename,
         double min, double max, size_t bin_count);
 
 /// Write histogram to file overriding existing file
@@ -63,20 +177,225 @@ int
 save_hist_to_file(const size_t *h, size_t n,
         const char *filename, int write_bin_numbers);
 
+/// Open a text histogram file for writing
+/// \param w Writer to initialize
+/// \param filename Name of the file to write
+/// \param line_count Expected number of lines, used to size the buffer
+int
+text_writer_open(struct text_writer *w, const char *filename,
+        size_t line_count);
+
+/// Append a histogram line, "<bin>: <count>" or "<count>"
+/// \param w Writer
+/// \param bin Bin number
+/// \param count Number of items in the bin
+/// \param write_bin_number Indicator to whether to write bin number or not
+int
+text_writer_line(struct text_writer *w, size_t bin, size_t count,
+        int write_bin_number);
+
+/// Append a joint histogram line, "<xbin> <ybin>: <count>"
+/// \param w Writer
+/// \param xbin Number of the x bin
+/// \param ybin Number of the y bin
+/// \param count Number of items in the cell
+int
+text_writer_cell(struct text_writer *w, size_t xbin, size_t ybin,
+        size_t count);
+
+/// Append text as is
+/// \param w Writer
+/// \param text Text to append
+int
+text_writer_text(struct text_writer *w, const char *text);
+
+/// Flush and close a text histogram file
+/// \param w Writer
+int
+text_writer_close(struct text_writer *w);
+
+/// Check whether a histogram file name denotes the binary format
+/// \param filename Name of the file
+/// \return Non-zero if filename ends with HIST_BINARY_EXT
+int
+hist_file_is_binary(const char *filename);
+
+/// Write histogram to file in binary format overriding existing file
+/// \param h Histogram to write
+/// \param n Length of the histogram
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+int
+save_hist_to_binary_file(const size_t *h, size_t n,
+        double min, double max, const char *filename);
+
+/// Write histogram to file in binary format if filename ends with
+/// HIST_BINARY_EXT, as text otherwise
+/// \param h Histogram to write
+/// \param n Length of the histogram
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+/// \param write_bin_numbers Indicator to whether to write bin numbers to
+///     a text file or not
+int
+save_hist(const size_t *h, size_t n, double min, double max,
+        const char *filename, int write_bin_numbers);
+
+/// Write counters behind a binary histogram header
+/// \param magic Magic number of the file
+/// \param counts Counters to write
+/// \param count_len Number of counters
+/// \param n Number of bins
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+int
+save_counts_to_binary_file(uint32_t magic, const size_t *counts,
+        size_t count_len, size_t n, double min, double max,
+        const char *filename);
+
+/// Map a file of counters behind a binary histogram header into memory
+/// \param filename Name of the file
+/// \param magic Expected magic number
+/// \param extra_counts Number of counters following the header beyond
+///     bin_count
+/// \param map Mapped file, released with unmap_hist_file
+int
+map_counts_file(const char *filename, uint32_t magic, size_t extra_counts,
+        struct hist_map *map);
+
+/// Map a file of (bin, value) pairs in increasing bin order behind a
+/// binary histogram header into memory
+/// \param filename Name of the file
+/// \param magic Expected magic number
+/// \param map Mapped file, its counts are the pairs, released with
+///     unmap_hist_file
+/// \param pair_count Number of pairs
+int
+map_pairs_file(const char *filename, uint32_t magic, struct hist_map *map,
+        size_t *pair_count);
+
+/// Map a binary histogram file into memory. A sparse file is expanded
+/// into zero-filled anonymous memory, which only takes pages for
+/// non-empty bins, and its header then has HIST_BIN_MAGIC.
+/// \param filename Name of the file
+/// \param map Mapped file, released with unmap_hist_file
+int
+map_hist_file(const char *filename, struct hist_map *map);
+
+/// Release a mapped binary histogram file
+/// \param map Mapped file
+void
+unmap_hist_file(struct hist_map *map);
+
 /// Generate histogram using numbers in file ifname and
-/// write histogram to file ofname without bin numbers
+/// write histogram to file ofname without bin numbers, or only
+/// non-empty bins with bin numbers if the histogram is sparse.
+/// The histogram is written in binary format if ofname ends with
+/// HIST_BINARY_EXT
 /// \param ifname Name of the file to read numbers from
-/// \param n Maximum number of numbers to read
 /// \param min Minimum value for histogram
 /// \param max Maximum value for histogram
 /// \param bin_count Number of bins
 /// \param ofname Name of the file to write histogram data
 int
-hist_from_file_to_file(const char *ifname, size_t n,
+hist_from_file_to_file(const char *ifname,
         double min, double max, size_t bin_count,
         const char *ofname);
 
-/// Merge multiple histogram files, <filename_prefix>N.txt, into dest
+/// Callback receiving a non-empty bin read from a histogram file
+typedef void (*hist_bin_fn)(void *ctx, size_t bin, size_t count);
+
+/// Select format of partial histogram files
+/// \param binary Non-zero for binary, zero for text
+void
+set_partial_hist_format(int binary);
+
+/// Get name of a partial histogram file, <filename_prefix>N.txt, or
+/// <filename_prefix>N.bin if partial histograms are binary
+/// \param filename_prefix Prefix for name of the file
+/// \param index Number of the partial histogram
+/// \return A new malloc-ed file name
+char *
+hist_file_name(const char *filename_prefix, size_t index);
+
+/// Read header of a binary histogram file, dense or sparse
+/// \param filename Name of the file
+/// \param header Header read from the file
+/// \return 0 if the file is a binary histogram, 1 otherwise
+int
+read_hist_header(const char *filename, struct hist_bin_header *header);
+
+/// Read bin count and edges of a histogram file that records them, a
+/// binary file or a sparse text file
+/// \param filename Name of the file
+/// \param header Header a binary file of the histogram would have
+/// \return 0 if the file records its edges, 1 otherwise
+int
+read_hist_edges(const char *filename, struct hist_bin_header *header);
+
+/// Read a histogram file, binary or text with or without bin numbers.
+/// Text files without a sparse header must have exactly bin_count lines,
+/// files recording their bin count must have bin_count bins.
+/// \param filename Name of the file to read
+/// \param bin_count Number of bins
+/// \param add Called with ctx for every non-empty bin
+/// \param ctx Passed to add
+int
+read_hist_file(const char *filename, size_t bin_count,
+        hist_bin_fn add, void *ctx);
+
+/// Reduce per-thread partial histograms pairwise in a tree, leaving the
+/// sum in partials[0]. Called by every thread with a barrier for all.
+/// \param partials Partial histograms, one per thread
+/// \param thread_num Number of the calling thread, from 0
+/// \param thread_count Number of threads
+/// \param len Length of each partial histogram
+/// \param barrier Barrier initialized for thread_count threads
+void
+hist_tree_reduce(size_t **partials, size_t thread_num, size_t thread_count,
+        size_t len, pthread_barrier_t *barrier);
+
+/// Merge histogram files in parallel into dest. Every thread sums a
+/// share of the files and partial sums are reduced pairwise in a tree.
+/// If every file is sparse, threads sum into sparse partials instead,
+/// which are added into dest one after another.
+/// \param dest Destination histogram, where histograms in files will be added
+/// \param bin_count Number of bins, every file must have this many bins
+/// \param filenames Names of the files containing histogram data
+/// \param file_count Number of files
+/// \param thread_count Number of threads to use
+/// \param edges If its magic is HIST_BIN_MAGIC, files recording edges must
+///     have its min and max, otherwise it is set to the edges of the first
+///     such file, see read_hist_edges. May be NULL to skip verifying edges.
+/// \return 0 on success, 1 if any file could not be merged
+int
+merge_hist_file_list(size_t dest[], size_t bin_count,
+        const char *const *filenames, size_t file_count,
+        size_t thread_count, struct hist_bin_header *edges);
+
+/// Merge histogram files in parallel into a sparse histogram, see
+/// merge_hist_file_list. Every thread sums into a sparse partial.
+/// \param dest Destination histogram, where histograms in files will be added
+/// \param filenames Names of the files containing histogram data
+/// \param file_count Number of files
+/// \param thread_count Number of threads to use
+/// \param edges See merge_hist_file_list
+/// \return 0 on success, 1 if any file could not be merged
+int
+merge_sparse_hist_file_list(struct sparse_hist *dest,
+        const char *const *filenames, size_t file_count,
+        size_t thread_count, struct hist_bin_header *edges);
+
+/// Check whether a histogram file keeps only non-empty bins
+/// \param filename Name of the file
+/// \return Non-zero if it is a sparse text or binary file
+int
+hist_file_is_sparse(const char *filename);
+
+/// Merge multiple histogram files, named as by hist_file_name, into dest
 /// \param dest Destination histogram, where histograms in files will be merged
 /// \param bin_count Number of bins
 /// \param filename_prefix Prefix for name of the files containing histogram data
@@ -85,6 +404,14 @@ int
 merge_hist_files(size_t dest[], size_t bin_count, 
         const char *filename_prefix, size_t hist_count);
 
+/// Open a shared memory object, on the hugetlbfs if one is set
+/// \param shm_name Name of the object
+/// \param oflag Flags as for shm_open
+/// \param mode Mode as for shm_open
+/// \return File descriptor, -1 with errno set on error
+int
+open_shm(const char *shm_name, int oflag, mode_t mode);
+
 int
 create_shm(const char *shm_name, size_t shm_size);
 
@@ -94,17 +421,38 @@ get_shm(const char *shm_name, size_t shm_size, int *fd);
 int
 cleanup_shm(void *shmp, const char *shm_name, size_t shm_size, int fd);
 
+int
+unlink_shm(const char *shm_name);
+
 int
 create_sem(const char *sem_name);
 
+/// Like create_sem, but keep a semaphore that already exists
+int
+reuse_sem(const char *sem_name);
+
 sem_t *
 open_wait_sem(const char *sem_name);
 
 int
 post_close_sem(sem_t *sem, const char *sem_name);
 
+/// Parse leading options of the histogram programs and apply them
+/// \param argc Argument count
+/// \param argv Argument vector
+/// \param supported Letters of the options the program supports, an
+///     option of another program is an error
+/// \param opts Parsed options
+/// \return Index of the first positional argument, -1 on error
+int
+parse_options(int argc, char **argv, const char *supported,
+        struct hist_options *opts);
+
+/// Print usage of a histogram program
+/// \param prog Name of the program
+/// \param supported Letters of the options the program supports
 void
-print_usage(const char *prog);
+print_usage(const char *prog, const char *supported);
 
 #endif //PROJECT1_HELPER_H
 
@@ -0,0 +1,222 @@
+#include "hist2d.h"
+#include "helper.h"
+#include "input.h"
+
+#include <memory.h>
+#include <stdio.h>
+
+static size_t
+cell_of(const struct hist2d *g, size_t xbin, size_t ybin) {
+    size_t tile = (ybin >> HIST2D_TILE_SHIFT) * g->xtiles +
+        (xbin >> HIST2D_TILE_SHIFT);
+    size_t offset = ((ybin & (HIST2D_TILE_DIM - 1)) << HIST2D_TILE_SHIFT) |
+        (xbin & (HIST2D_TILE_DIM - 1));
+
+    return tile * HIST2D_TILE_CELLS + offset;
+}
+
+int
+hist2d_init(struct hist2d *g, double xmin, double xmax, size_t xbins,
+        double ymin, double ymax, size_t ybins) {
+    if (!g || xbins == 0 || ybins == 0) {
+        EINVALID_ARGS("hist2d_init");
+        return 1;
+    }
+
+    memset(g, 0, sizeof(*g));
+    g->xmin = xmin < xmax ? xmin : xmax;
+    g->xmax = xmin < xmax ? xmax : xmin;
+    g->ymin = ymin < ymax ? ymin : ymax;
+    g->ymax = ymin < ymax ? ymax : ymin;
+    g->xbins = xbins;
+    g->ybins = ybins;
+    g->xtiles = (xbins + HIST2D_TILE_DIM - 1) >> HIST2D_TILE_SHIFT;
+    g->ytiles = (ybins + HIST2D_TILE_DIM - 1) >> HIST2D_TILE_SHIFT;
+    g->cell_count = g->xtiles * g->ytiles * HIST2D_TILE_CELLS;
+
+    g->cells = (size_t *)alloc_block(sizeof(size_t) * g->cell_count);
+    if (!g->cells) return 1;
+    memset(g->cells, 0, sizeof(size_t) * g->cell_count);
+
+    return 0;
+}
+
+void
+hist2d_destroy(struct hist2d *g) {
+    if (!g || !g->cells) return;
+
+    free_block(g->cells, sizeof(size_t) * g->cell_count);
+    g->cells = NULL;
+}
+
+/// Bin a chunk of pairs, grouping cell updates by tile for large grids
+static void
+add_chunk(struct hist2d *g, const double *pairs, size_t n,
+        size_t *cells, size_t *sorted, size_t *tile_start) {
+    size_t tile_count = g->xtiles * g->ytiles;
+    size_t m = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t xbin = hist_bin_index(pairs[2 * i], g->xmin, g->xmax,
+                g->xbins);
+        size_t ybin = hist_bin_index(pairs[2 * i + 1], g->ymin, g->ymax,
+                g->ybins);
+        if (xbin == HIST_NO_BIN || ybin == HIST_NO_BIN) continue;
+
+        cells[m++] = cell_of(g, xbin, ybin);
+    }
+
+    if (tile_count <= HIST2D_DIRECT_TILES) {
+        for (size_t i = 0; i < m; i++) {
+            g->cells[cells[i]]++;
+        }
+        return;
+    }
+
+    // Counting sort of the cells by tile, then count tile by tile
+    memset(tile_start, 0, sizeof(size_t) * (tile_count + 1));
+    for (size_t i = 0; i < m; i++) {
+        tile_start[(cells[i] / HIST2D_TILE_CELLS) + 1]++;
+    }
+    for (size_t t = 0; t < tile_count; t++) {
+        tile_start[t + 1] += tile_start[t];
+    }
+    for (size_t i = 0; i < m; i++) {
+        sorted[tile_start[cells[i] / HIST2D_TILE_CELLS]++] = cells[i];
+    }
+
+    for (size_t i = 0; i < m; i++) {
+        g->cells[sorted[i]]++;
+    }
+}
+
+struct chunk_buffers {
+    size_t  *cells;
+    size_t  *sorted;
+    size_t  *tile_start;
+    size_t  tile_count;
+};
+
+static int
+chunk_buffers_alloc(struct chunk_buffers *b, const struct hist2d *g) {
+    b->tile_count = g->xtiles * g->ytiles;
+    b->cells = (size_t *)malloc(sizeof(size_t) * HIST2D_CHUNK);
+    b->sorted = (size_t *)malloc(sizeof(size_t) * HIST2D_CHUNK);
+    b->tile_start = (size_t *)malloc(sizeof(size_t) * (b->tile_count + 1));
+    if (!b->cells || !b->sorted || !b->tile_start) {
+        perror("malloc");
+        free(b->cells);
+        free(b->sorted);
+        free(b->tile_start);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+chunk_buffers_free(struct chunk_buffers *b) {
+    safe_free(b->cells, sizeof(size_t) * HIST2D_CHUNK);
+    safe_free(b->sorted, sizeof(size_t) * HIST2D_CHUNK);
+    safe_free(b->tile_start, sizeof(size_t) * (b->tile_count + 1));
+}
+
+int
+hist2d_add(struct hist2d *g, const double *pairs, size_t n) {
+    if (!g || !pairs) {
+        EINVALID_ARGS("hist2d_add");
+        return 1;
+    }
+
+    struct chunk_buffers b;
+    if (chunk_buffers_alloc(&b, g) != 0) return 1;
+
+    for (size_t i = 0; i < n; i += HIST2D_CHUNK) {
+        size_t m = n - i < HIST2D_CHUNK ? n - i : HIST2D_CHUNK;
+        add_chunk(g, pairs + 2 * i, m, b.cells, b.sorted, b.tile_start);
+    }
+
+    chunk_buffers_free(&b);
+
+    return 0;
+}
+
+int
+hist2d_add_file(struct hist2d *g, const char *filename) {
+    if (!g || !filename) {
+        EINVALID_ARGS("hist2d_add_file");
+        return 1;
+    }
+
+    struct input in;
+    if (input_open(&in, filename) == -1) return 1;
+
+    struct chunk_buffers b;
+    double *pairs = (double *)malloc(sizeof(double) * 2 * HIST2D_CHUNK);
+    if (!pairs || chunk_buffers_alloc(&b, g) != 0) {
+        if (!pairs) perror("malloc");
+        free(pairs);
+        input_close(&in);
+        return 1;
+    }
+
+    // Read a chunk of pairs at a time, the file may not fit in memory
+    int result = 0;
+    ssize_t m;
+    do {
+        m = input_numbers(&in, pairs, 2 * HIST2D_CHUNK);
+        if (m == -1 || m % 2 != 0) {
+            fprintf(stderr, "hist2d_add_file: %s: expected pairs of numbers\n",
+                    filename);
+            result = 1;
+            break;
+        }
+
+        add_chunk(g, pairs, (size_t)m / 2, b.cells, b.sorted, b.tile_start);
+    } while (m == 2 * HIST2D_CHUNK);
+
+    chunk_buffers_free(&b);
+    safe_free(pairs, sizeof(double) * 2 * HIST2D_CHUNK);
+    if (input_close(&in) == -1) result = 1;
+
+    return result;
+}
+
+size_t
+hist2d_get(const struct hist2d *g, size_t xbin, size_t ybin) {
+    if (!g || xbin >= g->xbins || ybin >= g->ybins) return 0;
+
+    return g->cells[cell_of(g, xbin, ybin)];
+}
+
+int
+save_hist2d_to_file(const struct hist2d *g, const char *filename, int sparse) {
+    if (!g || !filename) return 1;
+
+    struct text_writer w;
+    if (text_writer_open(&w, filename, g->xbins * g->ybins) != 0) return 1;
+
+    // Sparse files record the grid, like sparse 1D files, as cells
+    // alone do not tell its size
+    int result = 0;
+    if (sparse) {
+        char header[192];
+        snprintf(header, sizeof(header),
+                "%c %lu %lu %.17g %.17g %.17g %.17g\n", HIST_SPARSE_MARK,
+                g->xbins, g->ybins, g->xmin, g->xmax, g->ymin, g->ymax);
+        result = text_writer_text(&w, header);
+    }
+
+    for (size_t i = 0; i < g->xbins && result == 0; i++) {
+        for (size_t j = 0; j < g->ybins && result == 0; j++) {
+            size_t count = hist2d_get(g, i, j);
+            if (sparse && count == 0) continue;
+
+            result = text_writer_cell(&w, i + 1, j + 1, count);
+        }
+    }
+
+    if (text_writer_close(&w) != 0) result = 1;
+
+    return result;
+}
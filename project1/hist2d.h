@@ -0,0 +1,80 @@
+#ifndef PROJECT1_HIST2D_H
+#define PROJECT1_HIST2D_H
+
+#include <stdlib.h>
+
+/// Tiles are 2^HIST2D_TILE_SHIFT bins on a side
+#define HIST2D_TILE_SHIFT 6
+
+#define HIST2D_TILE_DIM (1UL << HIST2D_TILE_SHIFT)
+
+#define HIST2D_TILE_CELLS (HIST2D_TILE_DIM * HIST2D_TILE_DIM)
+
+/// Grids of at most this many tiles fit in cache and are counted directly
+#define HIST2D_DIRECT_TILES 16
+
+/// Number of pairs binned at a time
+#define HIST2D_CHUNK 65536
+
+/// Joint histogram of pairs. Counters are stored tile by tile so that
+/// a chunk of pairs can be counted one cache-resident tile at a time.
+struct hist2d {
+    double  xmin;
+    double  xmax;
+    double  ymin;
+    double  ymax;
+    size_t  xbins;
+    size_t  ybins;
+    size_t  xtiles;
+    size_t  ytiles;
+    size_t  cell_count;
+    size_t  *cells;
+};
+
+/// Create an empty joint histogram
+/// \param g Histogram to initialize, released with hist2d_destroy
+/// \param xmin Minimum x value
+/// \param xmax Maximum x value
+/// \param xbins Number of x bins
+/// \param ymin Minimum y value
+/// \param ymax Maximum y value
+/// \param ybins Number of y bins
+int
+hist2d_init(struct hist2d *g, double xmin, double xmax, size_t xbins,
+        double ymin, double ymax, size_t ybins);
+
+/// Release a joint histogram
+/// \param g Histogram to release
+void
+hist2d_destroy(struct hist2d *g);
+
+/// Add pairs to a joint histogram
+/// \param g Histogram
+/// \param pairs Pairs as x0, y0, x1, y1, ...
+/// \param n Number of pairs
+int
+hist2d_add(struct hist2d *g, const double *pairs, size_t n);
+
+/// Add pairs in a file, two numbers per line, to a joint histogram
+/// \param g Histogram
+/// \param filename Name of the file to read
+int
+hist2d_add_file(struct hist2d *g, const char *filename);
+
+/// Get count of a cell
+/// \param g Histogram
+/// \param xbin Index of the x bin
+/// \param ybin Index of the y bin
+size_t
+hist2d_get(const struct hist2d *g, size_t xbin, size_t ybin);
+
+/// Write a joint histogram as "<xbin> <ybin>: <count>" lines in x-major
+/// order, bins starting at 1
+/// \param g Histogram to write
+/// \param filename Name of the file to write
+/// \param sparse Non-zero to write only non-empty cells, after a line
+///     "# <xbins> <ybins> <xmin> <xmax> <ymin> <ymax>", see HIST_SPARSE_MARK
+int
+save_hist2d_to_file(const struct hist2d *g, const char *filename, int sparse);
+
+#endif //PROJECT1_HIST2D_H
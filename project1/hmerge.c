@@ -0,0 +1,146 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "sparse.h"
+
+
+static void
+print_merge_usage(void) {
+    printf("Usage:\n");
+    printf("\thmerge [-j THREADS] [-r MINVAL MAXVAL] [BINCOUNT] [OFILE]"
+           " [IFILE]...\n");
+    printf("\t-j\tNumber of merge threads, defaults to online CPUs\n");
+    printf("\t-r\tEdges binary and sparse IFILEs must have, written to a"
+           " binary OFILE\n");
+    printf("\tIFILE - reads further file names from standard input,"
+           " one per line\n");
+}
+
+/// Append names read from stdin, one per line, to a growing name list
+static int
+read_names_from_stdin(char ***names, size_t *count, size_t *capacity) {
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &line_size, stdin)) != -1) {
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len == 0) continue;
+
+        if (*count == *capacity) {
+            *capacity *= 2;
+            char **grown = realloc(*names, sizeof(char *) * *capacity);
+            if (!grown) {
+                perror("realloc");
+                free(line);
+                return 1;
+            }
+            *names = grown;
+        }
+
+        (*names)[(*count)++] = strdup(line);
+    }
+
+    free(line);
+    return 0;
+}
+
+
+int
+main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 0 ? (size_t)cpus : 1;
+
+    struct hist_bin_header edges;
+    memset(&edges, 0, sizeof(edges));
+
+    int arg = 1;
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+            sscanf(argv[++arg], "%lu", &thread_count);
+        } else if (strcmp(argv[arg], "-r") == 0 && arg + 2 < argc) {
+            sscanf(argv[++arg], "%lf", &edges.min);
+            sscanf(argv[++arg], "%lf", &edges.max);
+            edges.magic = HIST_BIN_MAGIC;
+        } else {
+            break;
+        }
+    }
+
+    if (argc - arg < 3) {
+        print_merge_usage();
+        return 0;
+    }
+
+    size_t bin_count = 0;
+    sscanf(argv[arg], "%lu", &bin_count);
+    const char *ofname = argv[arg + 1];
+
+    size_t capacity = (size_t)(argc - arg) + 16;
+    size_t file_count = 0;
+    char **names = calloc(capacity, sizeof(char *));
+    if (names == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    for (int i = arg + 2; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            if (read_names_from_stdin(&names, &file_count, &capacity) != 0)
+                return 1;
+        } else {
+            names[file_count++] = strdup(argv[i]);
+        }
+    }
+
+    // Sparse inputs give a sparse result, a dense one may not fit
+    int sparse = file_count > 0;
+    for (size_t i = 0; i < file_count && sparse; i++) {
+        sparse = hist_file_is_sparse(names[i]);
+    }
+
+    size_t *result_hist = NULL;
+    struct sparse_hist *result_sparse = NULL;
+    if (sparse) {
+        result_sparse = sparse_hist_create(bin_count);
+        if (result_sparse == NULL) return 1;
+    } else {
+        result_hist = calloc(bin_count, sizeof(size_t));
+        if (result_hist == NULL) {
+            perror("calloc");
+            return 1;
+        }
+    }
+
+    int result = sparse ?
+        merge_sparse_hist_file_list(result_sparse,
+                (const char *const *)names, file_count, thread_count, &edges) :
+        merge_hist_file_list(result_hist, bin_count,
+                (const char *const *)names, file_count, thread_count, &edges);
+
+    if (result == 0) {
+        if (hist_file_is_binary(ofname) && edges.magic != HIST_BIN_MAGIC) {
+            ERROR("hmerge", "binary output needs edges, use -r or "
+                            "input files recording them");
+            result = 1;
+        } else if (sparse) {
+            result = save_sparse_hist(result_sparse, edges.min, edges.max,
+                    ofname);
+        } else {
+            result = save_hist(result_hist, bin_count, edges.min, edges.max,
+                    ofname, 1);
+        }
+    }
+
+    for (size_t i = 0; i < file_count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    safe_free(result_hist, sizeof(size_t) * bin_count);
+    sparse_hist_destroy(result_sparse);
+
+    return result;
+}
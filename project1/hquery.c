@@ -0,0 +1,63 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cumulative.h"
+
+
+static void
+print_query_usage(void) {
+    printf("Usage:\n");
+    printf("\thquery [FILE] count [A] [B]\n");
+    printf("\thquery [FILE] bins [FIRSTBIN] [LASTBIN]\n");
+    printf("\thquery [FILE] quantile [P]...\n");
+    printf("\thquery [FILE] index [OFILE]\n");
+    printf("\tFILE is an index file or a binary histogram file\n");
+}
+
+
+int
+main(int argc, char **argv) {
+    if (argc < 3) {
+        print_query_usage();
+        return 0;
+    }
+
+    struct hist_index idx;
+    if (hist_index_load(&idx, argv[1]) != 0) return 1;
+
+    int result = 0;
+    const char *query = argv[2];
+
+    if (strcmp(query, "count") == 0 && argc == 5) {
+        double a = 0.0, b = 0.0;
+        sscanf(argv[3], "%lf", &a);
+        sscanf(argv[4], "%lf", &b);
+        printf("%.6g\n", hist_index_range_count(&idx, a, b));
+    } else if (strcmp(query, "bins") == 0 && argc == 5) {
+        // Bins are numbered from 1 as in histogram files
+        size_t first = 0, last = 0;
+        sscanf(argv[3], "%lu", &first);
+        sscanf(argv[4], "%lu", &last);
+        if (first == 0 || last == 0) {
+            EINVALID_ARGS("hquery");
+            result = 1;
+        } else {
+            printf("%lu\n", hist_index_bin_range(&idx, first - 1, last - 1));
+        }
+    } else if (strcmp(query, "quantile") == 0 && argc > 3) {
+        for (int i = 3; i < argc; i++) {
+            double p = 0.0;
+            sscanf(argv[i], "%lf", &p);
+            printf("%.17g\n", hist_index_quantile(&idx, p));
+        }
+    } else if (strcmp(query, "index") == 0 && argc == 4) {
+        result = save_hist_index(&idx, argv[3]);
+    } else {
+        print_query_usage();
+    }
+
+    hist_index_destroy(&idx);
+
+    return result;
+}
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "live.h"
+
+
+static void
+print_watch_usage(void) {
+    printf("Usage:\n");
+    printf("\thwatch [-T HUGETLBFS] [-i SECONDS] [-n COUNT] [-f]\n");
+    printf("\thwatch [-T HUGETLBFS] -d\n");
+    printf("\t-i\tSeconds between snapshots, defaults to 1\n");
+    printf("\t-n\tStop after COUNT snapshots\n");
+    printf("\t-f\tKeep watching after all producers are done\n");
+    printf("\t-d\tRemove a histogram kept by syn_phistogram -L and its"
+           " semaphores\n");
+}
+
+
+int
+main(int argc, char **argv) {
+    double interval = 1.0;
+    size_t count = 0;
+    int follow = 0;
+    int drop = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            set_huge_pages(1, argv[++i]);
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%lf", &interval);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%lu", &count);
+        } else if (strcmp(argv[i], "-f") == 0) {
+            follow = 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            drop = 1;
+        } else {
+            print_watch_usage();
+            return 0;
+        }
+    }
+
+    if (drop) {
+        if (live_hist_remove(LIVE_SHM_NAME, LIVE_SEM_NAME) == 0) return 0;
+
+        ERROR("hwatch", "no kept histogram to remove");
+        return 1;
+    }
+
+    size_t size;
+    const void *shmp = live_hist_attach(LIVE_SHM_NAME, &size);
+    if (shmp == NULL) {
+        perror("live_hist_attach");
+        return 1;
+    }
+
+    const struct live_hist_header *shared = shmp;
+    if (size < sizeof(*shared) || shared->magic != LIVE_MAGIC ||
+            shared->version != LIVE_VERSION ||
+            size < live_hist_size(shared->bin_count, shared->slice_count)) {
+        ERROR("hwatch", LIVE_SHM_NAME " is not a live histogram");
+        live_hist_detach(shmp, size);
+        return 1;
+    }
+
+    size_t bin_count = shared->bin_count;
+    size_t *current = calloc(bin_count, sizeof(size_t));
+    size_t *previous = calloc(bin_count, sizeof(size_t));
+    if (current == NULL || previous == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    struct live_hist_header header;
+    int result = 0;
+    for (size_t n = 1; ; n++) {
+        if (live_hist_snapshot(shmp, current, &header) != 0) {
+            result = 1;
+            break;
+        }
+
+        printf("files %lu/%lu\n", header.files_done, header.files_total);
+        for (size_t i = 0; i < bin_count; i++) {
+            if (current[i] == previous[i]) continue;
+            printf("%lu: %lu (+%lu)\n", i + 1, current[i],
+                    current[i] - previous[i]);
+        }
+        fflush(stdout);
+
+        size_t *t = previous;
+        previous = current;
+        current = t;
+
+        if (count && n == count) break;
+        if (!follow && header.files_total > 0 &&
+                header.files_done == header.files_total)
+            break;
+
+        usleep((useconds_t)(interval * 1e6));
+    }
+
+    safe_free(current, sizeof(size_t) * bin_count);
+    safe_free(previous, sizeof(size_t) * bin_count);
+    live_hist_detach(shmp, size);
+
+    return result;
+}
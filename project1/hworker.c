@@ -0,0 +1,93 @@
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "net.h"
+
+
+static void
+print_worker_usage(void) {
+    printf("Usage:\n");
+    printf("\thworker [-s SECONDS] [HOST] [PORT]\n");
+    printf("\t-s\tWait before every result, to act as a straggler\n");
+}
+
+int
+main(int argc, char **argv) {
+    unsigned int delay = 0;
+
+    int arg = 1;
+    for (; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc) {
+            sscanf(argv[++arg], "%u", &delay);
+        } else {
+            break;
+        }
+    }
+
+    if (argc - arg > 2) {
+        print_worker_usage();
+        return 0;
+    }
+
+    const char *host = argc - arg > 0 ? argv[arg] : "localhost";
+    const char *port = argc - arg > 1 ? argv[arg + 1] : NET_DEFAULT_PORT;
+
+    int fd = net_connect(host, port);
+    if (fd == -1) exit(EXIT_FAILURE);
+
+    struct net_job job;
+    memset(&job, 0, sizeof(job));
+
+    struct net_msg msg;
+    void *payload;
+    int status = EXIT_FAILURE;
+
+    while (net_recv(fd, &msg, &payload, PATH_MAX) == 0) {
+        if (msg.type == NET_DONE) {
+            status = EXIT_SUCCESS;
+            break;
+        }
+
+        if (msg.type == NET_JOB && msg.length == sizeof(job)) {
+            memcpy(&job, payload, sizeof(job));
+            free(payload);
+            continue;
+        }
+
+        if (msg.type != NET_ASSIGN || job.bin_count == 0 || !payload) {
+            ERROR("hworker", "unexpected message");
+            free(payload);
+            break;
+        }
+
+        // Shard files are read by path, so they must be visible here
+        const char *path = payload;
+        size_t *hist = hist_from_file(path, job.min, job.max, job.bin_count);
+
+        if (delay) sleep(delay);
+
+        int sent = hist ?
+            net_send_hist(fd, msg.shard, hist, job.bin_count) :
+            net_send(fd, NET_FAIL, msg.shard, NULL, 0);
+
+        if (hist) free_block(hist, sizeof(size_t) * job.bin_count);
+        free(payload);
+
+        if (sent != 0) {
+            // A copy finishing after the job ends finds it closed
+            if (net_recv(fd, &msg, &payload, PATH_MAX) == 0) {
+                if (msg.type == NET_DONE) status = EXIT_SUCCESS;
+                free(payload);
+            }
+            break;
+        }
+    }
+
+    close(fd);
+
+    return status;
+}
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+
+#include "input.h"
+#include "helper.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+enum input_format
+input_format(const char *filename) {
+    unsigned char magic[4];
+
+    FILE *f = fopen(filename, "r");
+    if (!f) return INPUT_PLAIN;
+
+    size_t len = fread(magic, 1, sizeof(magic), f);
+    fclose(f);
+
+    if (len >= sizeof(gzip_magic) &&
+            memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0)
+        return INPUT_GZIP;
+    if (len >= sizeof(zstd_magic) &&
+            memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0)
+        return INPUT_ZSTD;
+
+    return INPUT_PLAIN;
+}
+
+static int
+write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += written;
+        len -= (size_t)written;
+    }
+
+    return 0;
+}
+
+/// Inflate into the pipe while the reader parses what came before
+static void *
+gunzip_thread(void *arg) {
+    struct input *in = (struct input *)arg;
+
+    // A reader closing early makes write fail instead of killing us
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    char *buf = (char *)malloc(INPUT_CHUNK);
+    if (!buf) {
+        perror("malloc");
+        in->status = 1;
+    }
+
+    int len = 0;
+    while (buf && (len = gzread(in->gz, buf, INPUT_CHUNK)) > 0) {
+        if (write_all(in->fd, buf, (size_t)len) != 0) {
+            if (errno != EPIPE) {
+                perror("write");
+                in->status = 1;
+            }
+            break;
+        }
+    }
+
+    int err;
+    const char *msg = gzerror(in->gz, &err);
+    if (buf && len <= 0 && err != Z_OK) {
+        fprintf(stderr, "gzread: %s\n", msg);
+        in->status = 1;
+    }
+
+    free(buf);
+    gzclose(in->gz);
+    close(in->fd);
+
+    return NULL;
+}
+
+static int
+open_pipe(int fds[2]) {
+    // Close on exec, or other children would hold the write end open
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        return -1;
+    }
+
+    // Fewer wake-ups between decompressor and parser, best effort
+    fcntl(fds[1], F_SETPIPE_SZ, INPUT_CHUNK);
+
+    return 0;
+}
+
+static int
+open_gzip(struct input *in, const char *filename, int fds[2]) {
+    in->gz = gzopen(filename, "rb");
+    if (!in->gz) {
+        perror("gzopen");
+        return -1;
+    }
+    gzbuffer(in->gz, INPUT_CHUNK);
+
+    in->fd = fds[1];
+    int err = pthread_create(&in->thread, NULL, gunzip_thread, in);
+    if (err != 0) {
+        errno = err;
+        perror("pthread_create");
+        gzclose(in->gz);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+open_zstd(struct input *in, const char *filename, int fds[2]) {
+    in->child = fork();
+    if (in->child == -1) {
+        perror("fork");
+        return -1;
+    }
+
+    if (in->child == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        execlp("zstd", "zstd", "-dcq", filename, (char *)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    return 0;
+}
+
+int
+input_open(struct input *in, const char *filename) {
+    if (!in || !filename) {
+        EINVALID_ARGS("input_open");
+        return -1;
+    }
+
+    memset(in, 0, sizeof(*in));
+    in->format = input_format(filename);
+
+    if (in->format == INPUT_PLAIN) {
+        in->f = fopen(filename, "r");
+        if (!in->f) {
+            perror("fopen");
+            return -1;
+        }
+        return 0;
+    }
+
+    int fds[2];
+    if (open_pipe(fds) == -1) return -1;
+
+    int opened = in->format == INPUT_GZIP ?
+        open_gzip(in, filename, fds) : open_zstd(in, filename, fds);
+    if (opened == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    in->f = fdopen(fds[0], "r");
+    if (!in->f) {
+        perror("fdopen");
+        close(fds[0]);
+        input_close(in);
+        return -1;
+    }
+    setvbuf(in->f, NULL, _IOFBF, INPUT_CHUNK);
+
+    return 0;
+}
+
+int
+input_close(struct input *in) {
+    if (!in) return -1;
+
+    // Closing first lets a decompressor still writing give up
+    if (in->f) fclose(in->f);
+    in->f = NULL;
+
+    if (in->format == INPUT_GZIP) {
+        pthread_join(in->thread, NULL);
+    } else if (in->format == INPUT_ZSTD) {
+        int status;
+        if (waitpid(in->child, &status, 0) == -1) {
+            perror("waitpid");
+            return -1;
+        }
+
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+            ERROR("input_close", "zstd not found");
+            in->status = 1;
+        } else if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0) &&
+                !(WIFSIGNALED(status) && WTERMSIG(status) == SIGPIPE)) {
+            ERROR("input_close", "zstd failed");
+            in->status = 1;
+        }
+    }
+
+    free(in->buf);
+    in->buf = NULL;
+
+    return in->status ? -1 : 0;
+}
+
+/// Move the unparsed tail to the front and read more after it
+static int
+refill(struct input *in) {
+    memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+    in->len -= in->pos;
+    in->pos = 0;
+
+    // One byte is kept to terminate the last number
+    size_t got = fread(in->buf + in->len, 1, INPUT_CHUNK - 1 - in->len,
+            in->f);
+    if (got == 0) {
+        if (ferror(in->f)) {
+            perror("fread");
+            return -1;
+        }
+        in->eof = 1;
+    }
+    in->len += got;
+
+    return 0;
+}
+
+ssize_t
+input_numbers(struct input *in, double *dest, size_t max) {
+    if (!in || !in->f || !dest) {
+        EINVALID_ARGS("input_numbers");
+        return -1;
+    }
+
+    if (!in->buf) {
+        in->buf = (char *)malloc(INPUT_CHUNK);
+        if (!in->buf) {
+            perror("malloc");
+            return -1;
+        }
+    }
+
+    size_t count = 0;
+    while (count < max) {
+        char *buf = in->buf;
+        size_t pos = in->pos;
+        while (pos < in->len && isspace((unsigned char)buf[pos])) pos++;
+
+        size_t end = pos;
+        while (end < in->len && !isspace((unsigned char)buf[end])) end++;
+
+        in->pos = pos;
+        if (end == in->len && !in->eof) {
+            // A number no chunk can hold is not a number
+            if (pos == 0 && in->len == INPUT_CHUNK - 1) return -1;
+            if (refill(in) == -1) return -1;
+            continue;
+        }
+        if (pos == end) break;
+
+        buf[end] = '\0';
+        char *q;
+        dest[count] = strtod(buf + pos, &q);
+        if (q != buf + end) return -1;
+
+        count++;
+        in->pos = end < in->len ? end + 1 : end;
+    }
+
+    return (ssize_t)count;
+}
+
+static uint64_t
+read_le(const unsigned char *p, size_t len) {
+    uint64_t x = 0;
+    for (size_t i = len; i > 0; i--) {
+        x = (x << 8) | p[i - 1];
+    }
+
+    return x;
+}
+
+/// Content size from the header of the first zstd frame, 0 if absent
+static size_t
+zstd_content_size(FILE *f) {
+    unsigned char hdr[18];
+    size_t len = fread(hdr, 1, sizeof(hdr), f);
+    if (len < 5) return 0;
+
+    unsigned char fhd = hdr[4];
+    unsigned fcs_flag = fhd >> 6;
+    unsigned single_segment = (fhd >> 5) & 1;
+    static const size_t dict_id_size[] = { 0, 1, 2, 4 };
+
+    size_t pos = 5 + !single_segment + dict_id_size[fhd & 3];
+    size_t fcs_size = fcs_flag == 0 ? single_segment : 1U << fcs_flag;
+    if (fcs_size == 0 || pos + fcs_size > len) return 0;
+
+    uint64_t size = read_le(hdr + pos, fcs_size);
+
+    return (size_t)(fcs_size == 2 ? size + 256 : size);
+}
+
+size_t
+input_size(const char *filename) {
+    struct stat st;
+    if (!filename || stat(filename, &st) == -1) return 0;
+
+    size_t size = (size_t)st.st_size;
+    enum input_format format = input_format(filename);
+    if (format == INPUT_PLAIN) return size;
+
+    FILE *f = fopen(filename, "r");
+    if (!f) return size;
+
+    size_t content_size = 0;
+    if (format == INPUT_ZSTD) {
+        content_size = zstd_content_size(f);
+    } else if (size >= 4 && fseek(f, -4, SEEK_END) == 0) {
+        // Size modulo 2^32 of the last member
+        unsigned char isize[4];
+        if (fread(isize, 1, sizeof(isize), f) == sizeof(isize))
+            content_size = (size_t)read_le(isize, sizeof(isize));
+    }
+
+    fclose(f);
+
+    return content_size > size ? content_size : size;
+}
@@ -0,0 +1,62 @@
+#ifndef PROJECT1_INPUT_H
+#define PROJECT1_INPUT_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdio.h>
+
+#define INPUT_CHUNK (1U << 20)
+
+enum input_format { INPUT_PLAIN, INPUT_GZIP, INPUT_ZSTD };
+
+/// An input file read as text whatever it is stored as
+struct input {
+    FILE               *f;          // decompressed text
+    enum input_format   format;
+    pthread_t           thread;     // gzip decompressor
+    pid_t               child;      // zstd decompressor
+    void               *gz;
+    int                 fd;         // write end of the pipe to f
+    int                 status;     // 0 unless decompression failed
+    char               *buf;        // text not parsed yet by input_numbers
+    size_t              pos;
+    size_t              len;
+    int                 eof;
+};
+
+/// Detect the format of a file from its magic bytes
+/// \param filename Name of the file
+/// \return Format of the file, INPUT_PLAIN if unknown or unreadable
+enum input_format
+input_format(const char *filename);
+
+/// Open a file for reading, decompressing on its own thread or process
+/// \param in Input to open
+/// \param filename Name of the file
+/// \return 0 on success, -1 on error
+int
+input_open(struct input *in, const char *filename);
+
+/// Close an input and wait for its decompressor
+/// \param in Input to close
+/// \return 0 on success, -1 if the file was not fully decompressed
+int
+input_close(struct input *in);
+
+/// Parse whitespace separated numbers, reading the input a chunk at a
+/// time instead of a number at a time
+/// \param in Input to read
+/// \param dest Array to store the numbers in
+/// \param max Maximum number of numbers to parse
+/// \return Number of numbers parsed, less than max only at the end of the
+///     input, -1 if the input holds something that is not a number
+ssize_t
+input_numbers(struct input *in, double *dest, size_t max);
+
+/// Size of a file after decompression, if its format records it
+/// \param filename Name of the file
+/// \return Decompressed size, else size on disk, 0 on error
+size_t
+input_size(const char *filename);
+
+#endif //PROJECT1_INPUT_H
@@ -0,0 +1,141 @@
+#include "kernels.h"
+#include "helper.h"
+
+// Integers up to 2^52 and their differences are exact in a double
+#define INTEGER_LIMIT 4503599627370496.0
+
+struct kernel_params {
+    double          min;
+    double          max;
+    double          span;
+    size_t          bin_count;
+    unsigned int    shift;
+};
+
+static int
+is_integer(double x) {
+    return x >= -INTEGER_LIMIT && x <= INTEGER_LIMIT && x == (double)(long)x;
+}
+
+/// Bin width as a power of two exponent, -1 if it is not 2^k with
+/// integer min and max
+static int
+width_shift(double min, double max, size_t bin_count) {
+    if (!is_integer(min) || !is_integer(max) || min >= max) return -1;
+
+    double span = max - min;
+    for (int k = 0; k < 52; k++) {
+        if ((double)bin_count * (double)(1UL << k) == span) return k;
+    }
+
+    return -1;
+}
+
+/// Kernel for integer data over integer edges. Integers are placed with
+/// INDEX, anything else goes through hist_bin_index so results match it.
+#define DEFINE_INTEGER_KERNEL(name, INDEX)                                  \
+static void                                                                 \
+name(const double *src, size_t n, const struct kernel_params *p,           \
+        size_t *result) {                                                   \
+    for (size_t i = 0; i < n; i++) {                                        \
+        double x = src[i];                                                  \
+        double d = x - p->min;                                              \
+        if (!(d >= 0.0) || d > p->span) continue;                           \
+                                                                            \
+        size_t j;                                                           \
+        if (x == (double)(long)x) {                                         \
+            j = INDEX((size_t)d, p->shift);                                 \
+            if (j == p->bin_count) j--;                                     \
+        } else {                                                            \
+            j = hist_bin_index(x, p->min, p->max, p->bin_count);            \
+            if (j == HIST_NO_BIN) continue;                                 \
+        }                                                                   \
+                                                                            \
+        result[j]++;                                                        \
+    }                                                                       \
+}
+
+#define UNIT_INDEX(d, shift) ((void)(shift), (d))
+
+#define SHIFT_INDEX(d, shift) ((d) >> (shift))
+
+DEFINE_INTEGER_KERNEL(kernel_unit, UNIT_INDEX)
+
+DEFINE_INTEGER_KERNEL(kernel_shift, SHIFT_INDEX)
+
+static void
+kernel_generic(const double *src, size_t n, const struct kernel_params *p,
+        size_t *result) {
+    for (size_t i = 0; i < n; i++) {
+        size_t j = hist_bin_index(src[i], p->min, p->max, p->bin_count);
+        if (j != HIST_NO_BIN) result[j]++;
+    }
+}
+
+typedef void (*kernel_fn)(const double *, size_t,
+        const struct kernel_params *, size_t *);
+
+static const kernel_fn kernels[HIST_KERNEL_COUNT] = {
+    [HIST_KERNEL_GENERIC] = &kernel_generic,
+    [HIST_KERNEL_UNIT] = &kernel_unit,
+    [HIST_KERNEL_SHIFT] = &kernel_shift,
+};
+
+static const char *const kernel_names[HIST_KERNEL_COUNT] = {
+    [HIST_KERNEL_GENERIC] = "generic",
+    [HIST_KERNEL_UNIT] = "unit",
+    [HIST_KERNEL_SHIFT] = "shift",
+};
+
+int
+hist_kernel_applies(enum hist_kernel kernel,
+        double min, double max, size_t bin_count) {
+    switch (kernel) {
+        case HIST_KERNEL_GENERIC:
+            return 1;
+        case HIST_KERNEL_UNIT:
+            return width_shift(min, max, bin_count) == 0;
+        case HIST_KERNEL_SHIFT:
+            return width_shift(min, max, bin_count) >= 0;
+        default:
+            return 0;
+    }
+}
+
+enum hist_kernel
+hist_select_kernel(const double *src, size_t n,
+        double min, double max, size_t bin_count) {
+    int shift = width_shift(min, max, bin_count);
+    if (shift < 0) return HIST_KERNEL_GENERIC;
+
+    // Integer kernels only pay off if the data is integers
+    size_t check = n < KERNEL_SAMPLE_COUNT ? n : KERNEL_SAMPLE_COUNT;
+    for (size_t i = 0; i < check; i++) {
+        if (!is_integer(src[i])) return HIST_KERNEL_GENERIC;
+    }
+
+    return shift == 0 ? HIST_KERNEL_UNIT : HIST_KERNEL_SHIFT;
+}
+
+void
+hist_run_kernel(enum hist_kernel kernel, const double *src, size_t n,
+        double min, double max, size_t bin_count, size_t *result) {
+    struct kernel_params p;
+    p.min = min;
+    p.max = max;
+    p.span = max - min;
+    p.bin_count = bin_count;
+
+    if (!hist_kernel_applies(kernel, min, max, bin_count))
+        kernel = HIST_KERNEL_GENERIC;
+
+    int shift = width_shift(min, max, bin_count);
+    p.shift = shift > 0 ? (unsigned int)shift : 0;
+
+    kernels[kernel](src, n, &p, result);
+}
+
+const char *
+hist_kernel_name(enum hist_kernel kernel) {
+    return kernel < HIST_KERNEL_COUNT ? kernel_names[kernel] : "unknown";
+}
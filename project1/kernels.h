@@ -0,0 +1,54 @@
+#ifndef PROJECT1_KERNELS_H
+#define PROJECT1_KERNELS_H
+
+#include <stdlib.h>
+
+/// Binning kernels, all count exactly as hist_bin_index does
+enum hist_kernel {
+    HIST_KERNEL_GENERIC,    // hist_bin_index for every number
+    HIST_KERNEL_UNIT,       // integers, bins of width 1, direct counting
+    HIST_KERNEL_SHIFT,      // integers, bins of width 2^k, subtract and shift
+    HIST_KERNEL_COUNT
+};
+
+/// Number of leading numbers checked to decide whether data is integers
+#define KERNEL_SAMPLE_COUNT 64
+
+/// Pick the fastest kernel for a configuration
+/// \param src Source data, a prefix of it is checked for integers
+/// \param n Number of items in src
+/// \param min Minimum number, not greater than max
+/// \param max Maximum number
+/// \param bin_count Number of bins
+enum hist_kernel
+hist_select_kernel(const double *src, size_t n,
+        double min, double max, size_t bin_count);
+
+/// Check whether a kernel can be used for a configuration
+/// \param kernel Kernel to check
+/// \param min Minimum number, not greater than max
+/// \param max Maximum number
+/// \param bin_count Number of bins
+/// \return Non-zero if the kernel applies
+int
+hist_kernel_applies(enum hist_kernel kernel,
+        double min, double max, size_t bin_count);
+
+/// Add numbers into a histogram with a kernel that applies
+/// \param kernel Kernel to use
+/// \param src Source data
+/// \param n Number of items in src
+/// \param min Minimum number, not greater than max
+/// \param max Maximum number
+/// \param bin_count Number of bins
+/// \param result Histogram to add into
+void
+hist_run_kernel(enum hist_kernel kernel, const double *src, size_t n,
+        double min, double max, size_t bin_count, size_t *result);
+
+/// Get name of a kernel
+/// \param kernel Kernel
+const char *
+hist_kernel_name(enum hist_kernel kernel);
+
+#endif //PROJECT1_KERNELS_H
@@ -0,0 +1,239 @@
+#include "live.h"
+#include "helper.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t *
+seq_of(const void *shmp, size_t slice) {
+    return (uint64_t *)((char *)shmp + LIVE_LINE_SIZE * (slice + 1));
+}
+
+static size_t *
+slice_of(const void *shmp, size_t slice) {
+    const struct live_hist_header *header = shmp;
+    char *bins = (char *)shmp + LIVE_LINE_SIZE * (header->slice_count + 1);
+
+    return (size_t *)bins + slice * header->bin_count;
+}
+
+size_t
+live_hist_size(size_t bin_count, size_t slice_count) {
+    return LIVE_LINE_SIZE * (slice_count + 1) +
+        sizeof(size_t) * bin_count * slice_count;
+}
+
+int
+live_hist_create(const char *shm_name, double min, double max,
+        size_t bin_count, size_t slice_count) {
+    size_t shm_size = live_hist_size(bin_count, slice_count);
+    if (create_shm(shm_name, shm_size) == -1) return -1;
+
+    int fd;
+    struct live_hist_header *header = get_shm(shm_name, shm_size, &fd);
+    if (!header) return -1;
+
+    header->magic = LIVE_MAGIC;
+    header->version = LIVE_VERSION;
+    header->bin_count = bin_count;
+    header->slice_count = slice_count;
+    header->min = min;
+    header->max = max;
+
+    return cleanup_shm(header, shm_name, shm_size, fd);
+}
+
+static int
+header_matches(const struct live_hist_header *header, size_t size,
+        double min, double max, size_t bin_count) {
+    if (size < sizeof(*header) || header->magic != LIVE_MAGIC ||
+            header->version != LIVE_VERSION)
+        return 0;
+
+    return header->bin_count == bin_count && header->min == min &&
+        header->max == max &&
+        size >= live_hist_size(header->bin_count, header->slice_count);
+}
+
+int
+live_hist_reuse(const char *shm_name, double min, double max,
+        size_t bin_count, size_t *slice_count) {
+    if (!shm_name || !slice_count) return -1;
+
+    size_t size;
+    const struct live_hist_header *header = live_hist_attach(shm_name, &size);
+    if (!header) return errno == ENOENT ? 1 : -1;
+
+    int result = -1;
+    if (header_matches(header, size, min, max, bin_count)) {
+        *slice_count = header->slice_count;
+        result = 0;
+    } else {
+        fprintf(stderr, "live_hist_reuse: %s holds a different histogram\n",
+                shm_name);
+    }
+
+    live_hist_detach(header, size);
+
+    return result;
+}
+
+void
+live_hist_start(void *shmp, size_t file_count) {
+    struct live_hist_header *header = shmp;
+
+    __atomic_fetch_add(&header->files_total, file_count, __ATOMIC_RELAXED);
+}
+
+void
+live_hist_add(void *shmp, size_t slice, const size_t *h) {
+    struct live_hist_header *header = shmp;
+    uint64_t *seq = seq_of(shmp, slice);
+    size_t *bins = slice_of(shmp, slice);
+
+    // Odd sequence tells readers the slice is being written
+    uint64_t s = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    __atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (size_t i = 0; i < header->bin_count; i++) {
+        size_t v = __atomic_load_n(&bins[i], __ATOMIC_RELAXED);
+        __atomic_store_n(&bins[i], v + h[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&header->files_done, 1, __ATOMIC_RELAXED);
+}
+
+static double
+monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int
+live_hist_snapshot(const void *shmp, size_t *dest,
+        struct live_hist_header *header) {
+    const struct live_hist_header *h = shmp;
+    size_t bin_count = h->bin_count;
+
+    size_t *copy = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    if (!copy) return 1;
+
+    if (header) {
+        memcpy(header, h, sizeof(*header));
+        header->files_total = __atomic_load_n(&h->files_total,
+                __ATOMIC_RELAXED);
+        header->files_done = __atomic_load_n(&h->files_done,
+                __ATOMIC_RELAXED);
+    }
+
+    memset(dest, 0, sizeof(size_t) * bin_count);
+
+    for (size_t slice = 0; slice < h->slice_count; slice++) {
+        const uint64_t *seq = seq_of(shmp, slice);
+        const size_t *bins = slice_of(shmp, slice);
+        uint64_t before, after;
+        uint64_t odd = 0;
+        double odd_since = 0.0;
+
+        // Copy the slice until no producer wrote it meanwhile, adding
+        // it only once the copy is known to be consistent. A producer
+        // that died mid-update leaves the same odd sequence for good.
+        for (;;) {
+            before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+            if (before & 1) {
+                if (before != odd) {
+                    odd = before;
+                    odd_since = monotonic_seconds();
+                } else if (monotonic_seconds() - odd_since >=
+                        LIVE_STUCK_SECONDS) {
+                    fprintf(stderr, "live_hist_snapshot: slice %lu is stuck "
+                            "mid-update, its producer may have died\n",
+                            slice);
+                    free_block(copy, sizeof(size_t) * bin_count);
+                    return 1;
+                }
+                sched_yield();
+                continue;
+            }
+
+            for (size_t i = 0; i < bin_count; i++) {
+                copy[i] = __atomic_load_n(&bins[i], __ATOMIC_RELAXED);
+            }
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+            if (before == after) break;
+        }
+
+        for (size_t i = 0; i < bin_count; i++) {
+            dest[i] += copy[i];
+        }
+    }
+
+    free_block(copy, sizeof(size_t) * bin_count);
+
+    return 0;
+}
+
+const void *
+live_hist_attach(const char *shm_name, size_t *size) {
+    if (!shm_name || !size) return NULL;
+
+    int fd = open_shm(shm_name, O_RDONLY, 0);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+    void *shmp = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shmp == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    return shmp;
+}
+
+int
+live_hist_remove(const char *shm_name, const char *sem_prefix) {
+    if (!shm_name || !sem_prefix) return -1;
+
+    // Slices are numbered from 0 without gaps, so are their semaphores
+    char sem_name[64];
+    size_t slice = 0;
+    for (;; slice++) {
+        snprintf(sem_name, sizeof(sem_name), "%s%lu", sem_prefix, slice);
+        if (sem_unlink(sem_name) == -1) break;
+    }
+
+    int removed = unlink_shm(shm_name) == 0;
+    if (!removed && errno != ENOENT) perror("unlink_shm");
+
+    return removed || slice > 0 ? 0 : -1;
+}
+
+void
+live_hist_detach(const void *shmp, size_t size) {
+    if (!shmp) return;
+
+    if (munmap((void *)shmp, size) == -1)
+        perror("munmap");
+}
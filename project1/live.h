@@ -0,0 +1,113 @@
+#ifndef PROJECT1_LIVE_H
+#define PROJECT1_LIVE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define LIVE_SHM_NAME "/histshm"
+
+/// Prefix of the semaphore names of the slices, followed by the slice
+#define LIVE_SEM_NAME "/histsem"
+
+/// A slice left mid-update this many seconds is taken to have lost its
+/// producer
+#define LIVE_STUCK_SECONDS 5
+
+/// "HLIV" in little-endian memory
+#define LIVE_MAGIC 0x56494C48U
+
+#define LIVE_VERSION 1U
+
+/// Size of a cache line, sequence counters of slices are kept apart
+#define LIVE_LINE_SIZE 64
+
+/// Header of a live shared histogram. It is followed by a sequence
+/// counter per slice, each on its own cache line, and then by
+/// slice_count slices of bin_count counters. A slice is written by one
+/// producer at a time; its sequence counter is odd while it is written,
+/// so readers can copy it without locking and retry if it changed.
+struct live_hist_header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    bin_count;
+    uint64_t    slice_count;
+    double      min;
+    double      max;
+    uint64_t    files_total;
+    uint64_t    files_done;
+    uint64_t    reserved;
+};
+
+/// Size of a live shared histogram
+/// \param bin_count Number of bins
+/// \param slice_count Number of slices
+size_t
+live_hist_size(size_t bin_count, size_t slice_count);
+
+/// Create a live shared histogram, failing if it exists
+/// \param shm_name Name of the shared memory
+/// \param min Minimum value
+/// \param max Maximum value
+/// \param bin_count Number of bins
+/// \param slice_count Number of slices
+int
+live_hist_create(const char *shm_name, double min, double max,
+        size_t bin_count, size_t slice_count);
+
+/// Check for an existing live shared histogram to keep adding into
+/// \param shm_name Name of the shared memory
+/// \param min Minimum value it must have
+/// \param max Maximum value it must have
+/// \param bin_count Number of bins it must have
+/// \param slice_count Number of slices it has
+/// \return 0 if it exists and matches, 1 if it does not exist,
+///     -1 if it does not match or on error
+int
+live_hist_reuse(const char *shm_name, double min, double max,
+        size_t bin_count, size_t *slice_count);
+
+/// Announce producers that are about to add into the histogram
+/// \param shmp Mapped live shared histogram
+/// \param file_count Number of producers
+void
+live_hist_start(void *shmp, size_t file_count);
+
+/// Add a histogram into a slice and count its producer as done. Only one
+/// producer may write a slice at a time.
+/// \param shmp Mapped live shared histogram
+/// \param slice Slice to add into
+/// \param h Histogram to add, bin_count long
+void
+live_hist_add(void *shmp, size_t slice, const size_t *h);
+
+/// Take a consistent snapshot without blocking producers
+/// \param shmp Mapped live shared histogram
+/// \param dest Sum of all slices, bin_count long
+/// \param header Copy of the header, may be NULL
+/// \return 0 on success, 1 on error or if a slice stays mid-update for
+///     LIVE_STUCK_SECONDS
+int
+live_hist_snapshot(const void *shmp, size_t *dest,
+        struct live_hist_header *header);
+
+/// Map a live shared histogram read-only
+/// \param shm_name Name of the shared memory
+/// \param size Size of the mapping
+/// \return Mapped histogram, released with live_hist_detach
+const void *
+live_hist_attach(const char *shm_name, size_t *size);
+
+/// Remove a kept live shared histogram and the semaphores of its slices
+/// \param shm_name Name of the shared memory
+/// \param sem_prefix Prefix of the semaphore names
+/// \return 0 if anything was removed, -1 otherwise
+int
+live_hist_remove(const char *shm_name, const char *sem_prefix);
+
+/// Release a histogram mapped by live_hist_attach
+/// \param shmp Mapped histogram
+/// \param size Size of the mapping
+void
+live_hist_detach(const void *shmp, size_t size);
+
+#endif //PROJECT1_LIVE_H
@@ -0,0 +1,133 @@
+#include "multires.h"
+#include "helper.h"
+#include "cumulative.h"
+
+#include <memory.h>
+#include <stdio.h>
+
+/// Find the base edge equal to x, computed as hist computes it
+static int
+find_edge(double x, double base_min, double bin_width, size_t base_bins,
+        size_t *edge) {
+    double q = (x - base_min) / bin_width;
+    if (!(q > -1.0) || q > (double)base_bins + 1.0) return 1;
+
+    size_t j = q < 0.5 ? 0 : (size_t)(q + 0.5);
+    size_t lo = j > 0 ? j - 1 : 0;
+    size_t hi = j < base_bins ? j + 1 : base_bins;
+
+    for (j = lo; j <= hi; j++) {
+        if (base_min + bin_width * (double)j == x) {
+            *edge = j;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int
+hist_derive(const size_t *base, size_t base_bins,
+        double base_min, double base_max,
+        double min, double max, size_t bin_count, size_t *dest) {
+    if (!base || !dest || base_bins == 0 || bin_count == 0) {
+        EINVALID_ARGS("hist_derive");
+        return 1;
+    }
+
+    if (min > max) {
+        max = max + min;
+        min = max - min;
+        max = max - min;
+    }
+
+    if (base_min >= base_max || min == max) return HIST_NOT_ALIGNED;
+
+    double base_width = (base_max - base_min) / (double)base_bins;
+    double bin_width = (max - min) / (double)bin_count;
+
+    size_t first, last;
+    if (find_edge(min, base_min, base_width, base_bins, &first) != 0 ||
+            find_edge(max, base_min, base_width, base_bins, &last) != 0)
+        return HIST_NOT_ALIGNED;
+
+    if (last <= first || (last - first) % bin_count != 0)
+        return HIST_NOT_ALIGNED;
+
+    // The base counts numbers on an inner edge in the bin above it
+    if (last != base_bins) return HIST_NOT_ALIGNED;
+
+    // Edges hist would compute for the result, including the top one
+    // that bounds its last bin, must be base edges bit for bit, or
+    // numbers on them would land in other bins on a rescan
+    size_t ratio = (last - first) / bin_count;
+    for (size_t i = 0; i <= bin_count; i++) {
+        if (min + bin_width * (double)i !=
+                base_min + base_width * (double)(first + ratio * i))
+            return HIST_NOT_ALIGNED;
+    }
+
+    const size_t *src = base + first;
+    for (size_t i = 0; i < bin_count; i++) {
+        size_t sum = 0;
+        for (size_t j = 0; j < ratio; j++) {
+            sum += *src++;
+        }
+        dest[i] = sum;
+    }
+
+    return 0;
+}
+
+int
+derive_hist_file(const char *base_file, double min, double max,
+        size_t bin_count, const char *ofname, int write_index) {
+    if (!base_file || !ofname || bin_count == 0) {
+        EINVALID_ARGS("derive_hist_file");
+        return 1;
+    }
+
+    struct hist_map map;
+    if (map_hist_file(base_file, &map) != 0) return 1;
+
+    size_t hist_size = sizeof(size_t) * bin_count;
+    size_t *h = (size_t *)alloc_block(hist_size);
+    if (!h) {
+        unmap_hist_file(&map);
+        return 1;
+    }
+
+    int result = hist_derive(map.counts, map.header->bin_count,
+            map.header->min, map.header->max, min, max, bin_count, h);
+    unmap_hist_file(&map);
+
+    if (result == 0)
+        result = save_hist(h, bin_count, min, max, ofname, 1);
+
+    if (result == 0 && write_index)
+        result = save_hist_index_for(h, bin_count, min, max, ofname);
+
+    free_block(h, hist_size);
+
+    return result;
+}
+
+int
+try_derive_hist_file(const char *prog, const char *base_file,
+        double min, double max, size_t bin_count, const char *ofname,
+        int write_index) {
+    if (!base_file) return 1;
+
+    int derived = derive_hist_file(base_file, min, max, bin_count, ofname,
+            write_index);
+    if (derived == 0) return 0;
+
+    if (derived == HIST_NOT_ALIGNED)
+        fprintf(stderr, "%s: %s is not aligned, rescanning\n",
+                prog, base_file);
+    else
+        fprintf(stderr, "%s: %s cannot be used as a base, rescanning\n",
+                prog, base_file);
+
+    return 1;
+}
@@ -0,0 +1,57 @@
+#ifndef PROJECT1_MULTIRES_H
+#define PROJECT1_MULTIRES_H
+
+#include <stdlib.h>
+
+/// Returned when a histogram cannot be derived from a base histogram
+#define HIST_NOT_ALIGNED 2
+
+/// Derive a coarser histogram from a fine base histogram without
+/// rescanning data, counting as hist would. [min, max] must end at the
+/// base maximum, bin_count must divide the number of base bins in it and
+/// every edge hist computes for the result must equal a base edge.
+/// \param base Base histogram
+/// \param base_bins Number of bins in base
+/// \param base_min Minimum value of base
+/// \param base_max Maximum value of base
+/// \param min Minimum value of the derived histogram
+/// \param max Maximum value of the derived histogram
+/// \param bin_count Number of bins of the derived histogram
+/// \param dest Derived histogram, bin_count long
+/// \return 0 on success, HIST_NOT_ALIGNED if not derivable
+int
+hist_derive(const size_t *base, size_t base_bins,
+        double base_min, double base_max,
+        double min, double max, size_t bin_count, size_t *dest);
+
+/// Derive a histogram from a binary base histogram file, as hist would
+/// count it, and write it with bin numbers, in binary format if ofname
+/// ends with HIST_BINARY_EXT
+/// \param base_file Name of the binary base histogram file
+/// \param min Minimum value of the derived histogram
+/// \param max Maximum value of the derived histogram
+/// \param bin_count Number of bins of the derived histogram
+/// \param ofname Name of the file to write
+/// \param write_index Non-zero to also write cumulative counts, see
+///     save_hist_index_for
+/// \return 0 on success, HIST_NOT_ALIGNED if not derivable, 1 on error
+int
+derive_hist_file(const char *base_file, double min, double max,
+        size_t bin_count, const char *ofname, int write_index);
+
+/// Derive a histogram as derive_hist_file does, telling on stderr why
+/// the data has to be scanned if it cannot be derived
+/// \param prog Name of the program, for messages
+/// \param base_file Name of the binary base histogram file, or NULL
+/// \param min Minimum value of the derived histogram
+/// \param max Maximum value of the derived histogram
+/// \param bin_count Number of bins of the derived histogram
+/// \param ofname Name of the file to write
+/// \param write_index Non-zero to also write cumulative counts
+/// \return 0 if ofname was derived, 1 if the data has to be scanned
+int
+try_derive_hist_file(const char *prog, const char *base_file,
+        double min, double max, size_t bin_count, const char *ofname,
+        int write_index);
+
+#endif //PROJECT1_MULTIRES_H
@@ -0,0 +1,217 @@
+#include "net.h"
+#include "helper.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <errno.h>
+#include <memory.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static int
+send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+        if (sent == -1) {
+            // A peer that went away is reported by the caller
+            if (errno != EPIPE && errno != ECONNRESET) perror("send");
+            return 1;
+        }
+        p += sent;
+        len -= (size_t)sent;
+    }
+
+    return 0;
+}
+
+static int
+recv_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t got = recv(fd, p, len, 0);
+        if (got <= 0) return 1;
+        p += got;
+        len -= (size_t)got;
+    }
+
+    return 0;
+}
+
+int
+net_send(int fd, uint32_t type, uint64_t shard,
+        const void *payload, size_t length) {
+    struct net_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    msg.shard = shard;
+    msg.length = length;
+
+    if (send_all(fd, &msg, sizeof(msg)) != 0) return 1;
+    if (length > 0 && send_all(fd, payload, length) != 0) return 1;
+
+    return 0;
+}
+
+int
+net_recv(int fd, struct net_msg *msg, void **payload, size_t max_length) {
+    *payload = NULL;
+
+    if (recv_all(fd, msg, sizeof(*msg)) != 0) return 1;
+    if (msg->length > max_length) {
+        ERROR("net_recv", "message too long");
+        return 1;
+    }
+    if (msg->length == 0) return 0;
+
+    *payload = malloc(msg->length + 1);
+    if (!*payload) {
+        perror("malloc");
+        return 1;
+    }
+
+    if (recv_all(fd, *payload, msg->length) != 0) {
+        free(*payload);
+        *payload = NULL;
+        return 1;
+    }
+
+    // Paths are sent without a terminator
+    ((char *)*payload)[msg->length] = '\0';
+
+    return 0;
+}
+
+int
+net_send_hist(int fd, uint64_t shard, const size_t *h, size_t bin_count) {
+    size_t used = 0;
+    for (size_t i = 0; i < bin_count; i++) {
+        if (h[i]) used++;
+    }
+
+    if (2 * used >= bin_count)
+        return net_send(fd, NET_RESULT_DENSE, shard, h,
+                sizeof(size_t) * bin_count);
+
+    size_t *pairs = (size_t *)malloc(sizeof(size_t) * 2 * used + 1);
+    if (!pairs) {
+        perror("malloc");
+        return 1;
+    }
+
+    size_t k = 0;
+    for (size_t i = 0; i < bin_count; i++) {
+        if (!h[i]) continue;
+        pairs[k++] = i;
+        pairs[k++] = h[i];
+    }
+
+    int result = net_send(fd, NET_RESULT_SPARSE, shard, pairs,
+            sizeof(size_t) * k);
+    safe_free(pairs, sizeof(size_t) * 2 * used + 1);
+
+    return result;
+}
+
+int
+net_add_hist(const struct net_msg *msg, const void *payload,
+        size_t *dest, size_t bin_count) {
+    const size_t *counts = payload;
+
+    if (msg->type == NET_RESULT_DENSE) {
+        if (msg->length != sizeof(size_t) * bin_count) return 1;
+
+        for (size_t i = 0; i < bin_count; i++) {
+            dest[i] += counts[i];
+        }
+        return 0;
+    }
+
+    if (msg->type != NET_RESULT_SPARSE ||
+            msg->length % (2 * sizeof(size_t)) != 0)
+        return 1;
+
+    size_t pair_count = msg->length / (2 * sizeof(size_t));
+    for (size_t i = 0; i < pair_count; i++) {
+        if (counts[2 * i] >= bin_count) return 1;
+    }
+    for (size_t i = 0; i < pair_count; i++) {
+        dest[counts[2 * i]] += counts[2 * i + 1];
+    }
+
+    return 0;
+}
+
+size_t
+net_hist_max_length(size_t bin_count) {
+    return sizeof(size_t) * bin_count;
+}
+
+int
+net_listen(const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int err = getaddrinfo(NULL, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd == -1) {
+        perror("socket");
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(fd, res->ai_addr, res->ai_addrlen) == -1 ||
+            listen(fd, SOMAXCONN) == -1) {
+        perror("bind");
+        close(fd);
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+int
+net_connect(const char *host, const char *port) {
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+        return -1;
+    }
+
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd == -1) perror("connect");
+    freeaddrinfo(res);
+
+    return fd;
+}
@@ -0,0 +1,88 @@
+#ifndef PROJECT1_NET_H
+#define PROJECT1_NET_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NET_DEFAULT_PORT "34200"
+
+/// Messages between coordinator and workers. Both ends are assumed to
+/// share byte order, as when run on one host or one kind of machine.
+enum net_msg_type {
+    NET_JOB = 1,        // coordinator: struct net_job
+    NET_ASSIGN,         // coordinator: shard to histogram, path of its file
+    NET_RESULT_DENSE,   // worker: bin_count 64-bit counters
+    NET_RESULT_SPARSE,  // worker: (bin, count) pairs of non-empty bins
+    NET_FAIL,           // worker: shard could not be read
+    NET_DONE            // coordinator: no more work
+};
+
+struct net_msg {
+    uint32_t    type;
+    uint32_t    reserved;
+    uint64_t    shard;
+    uint64_t    length;
+};
+
+struct net_job {
+    double      min;
+    double      max;
+    uint64_t    bin_count;
+};
+
+/// Send a message
+/// \param fd Socket
+/// \param type Type of the message
+/// \param shard Shard the message is about
+/// \param payload Payload, may be NULL if length is 0
+/// \param length Length of the payload
+int
+net_send(int fd, uint32_t type, uint64_t shard,
+        const void *payload, size_t length);
+
+/// Receive a message
+/// \param fd Socket
+/// \param msg Header of the message
+/// \param payload New malloc-ed payload, NULL if empty
+/// \param max_length Largest payload accepted
+/// \return 0 on success, 1 if the peer closed or sent garbage
+int
+net_recv(int fd, struct net_msg *msg, void **payload, size_t max_length);
+
+/// Send a histogram, as non-empty bins only if that is smaller
+/// \param fd Socket
+/// \param shard Shard the histogram belongs to
+/// \param h Histogram
+/// \param bin_count Number of bins
+int
+net_send_hist(int fd, uint64_t shard, const size_t *h, size_t bin_count);
+
+/// Add a received histogram into dest
+/// \param msg Header of a NET_RESULT_DENSE or NET_RESULT_SPARSE message
+/// \param payload Payload of the message
+/// \param dest Histogram to add into
+/// \param bin_count Number of bins
+/// \return 0 on success, 1 if the payload does not fit bin_count
+int
+net_add_hist(const struct net_msg *msg, const void *payload,
+        size_t *dest, size_t bin_count);
+
+/// Largest payload a histogram of bin_count bins can take
+/// \param bin_count Number of bins
+size_t
+net_hist_max_length(size_t bin_count);
+
+/// Listen for workers on all addresses
+/// \param port Port to listen on
+/// \return Listening socket, -1 on error
+int
+net_listen(const char *port);
+
+/// Connect to a coordinator
+/// \param host Host name or address
+/// \param port Port
+/// \return Connected socket, -1 on error
+int
+net_connect(const char *host, const char *port);
+
+#endif //PROJECT1_NET_H
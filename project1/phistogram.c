@@ -5,12 +5,28 @@
 #include <unistd.h>
 
 #include "helper.h"
+#include "cumulative.h"
+#include "multires.h"
+#include "sparse.h"
+
+#define OPTIONS "HNBRI"
 
 
 int
 main(int argc, char **argv) {
+    struct hist_options opts;
+    int first_arg = parse_options(argc, argv, OPTIONS, &opts);
+    if (first_arg == -1) {
+        print_usage("phistogram", OPTIONS);
+        return 1;
+    }
+
+    // Skip options so positional arguments start at argv[1]
+    argc -= first_arg - 1;
+    argv += first_arg - 1;
+
     if (argc < 6) {
-        print_usage("phistogram");
+        print_usage("phistogram", OPTIONS);
         return 0;
     }
 
@@ -24,10 +40,15 @@ main(int argc, char **argv) {
     sscanf(argv[4], "%lu", &file_count);
 
     if ((size_t)argc < (6U + file_count)) {
-        print_usage("phistogram");
+        print_usage("phistogram", OPTIONS);
         return 0;
     }
 
+    // Answer from a finer histogram built earlier if possible
+    if (try_derive_hist_file("phistogram", opts.base_file, min, max,
+                bin_count, argv[5U + file_count], opts.index) == 0)
+        return 0;
+
     pid_t pid;
     for (size_t i = 5; i < file_count + 5; i++) {
         size_t relative_index = i - 5;
@@ -39,16 +60,19 @@ main(int argc, char **argv) {
         }
 
         if (pid == 0) {
+            if (opts.numa)
+                pin_to_numa_node((int)(relative_index % opts.node_count));
+
             // Create histogram from file
-            char ofname[256];
-            snprintf(ofname, 256, "hist%lu.txt", relative_index + 1);
+            char *ofname = hist_file_name("hist", relative_index + 1);
+            if (ofname == NULL) exit(EXIT_FAILURE);
 
-            size_t lines = line_count(argv[i]);
-            if (hist_from_file_to_file(argv[i], lines,
+            if (hist_from_file_to_file(argv[i],
                         min, max, bin_count, ofname) != 0) {
                 exit(EXIT_FAILURE);
             }
 
+            free(ofname);
             exit(EXIT_SUCCESS);
         }
     }
@@ -56,19 +80,55 @@ main(int argc, char **argv) {
     // Wait for all childs to finish
     size_t pid_count = file_count;
     int status;
+    int failed = 0;
     while (pid_count > 0) {
         wait(&status);
+        if (status != EXIT_SUCCESS) failed = 1;
         --pid_count;
     }
+
+    // A partial left over from an earlier run must not stand in
+    if (failed) exit(EXIT_FAILURE);
     
-    // Merge histograms from intermediate files
-    size_t result_hist[bin_count];
+    // Keep the result sparse if few bins can be occupied
+    size_t sample_estimate = 0;
+    for (size_t i = 5; i < file_count + 5; i++)
+        sample_estimate += estimate_sample_count(argv[i]);
+
+    if (hist_should_be_sparse(sample_estimate, bin_count)) {
+        struct sparse_hist *sh = sparse_hist_create(bin_count);
+        if (sh == NULL) return 1;
+
+        if (merge_sparse_hist_files(sh, "hist", file_count) != 0) {
+            sparse_hist_destroy(sh);
+            return 1;
+        }
+
+        int status = save_sparse_hist(sh, min, max, argv[5U + file_count]);
+        if (status == 0 && opts.index)
+            status = save_sparse_hist_index_for(sh, min, max,
+                    argv[5U + file_count]);
+        sparse_hist_destroy(sh);
+
+        return status;
+    }
+
+    // Merge histograms from intermediate files, on the heap as there may
+    // be too many bins for the stack
+    size_t *result_hist = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    if (result_hist == NULL) return 1;
     memset(result_hist, 0, sizeof(size_t) * bin_count);
 
-    merge_hist_files(result_hist, bin_count, "hist", file_count);
+    int result = merge_hist_files(result_hist, bin_count, "hist", file_count);
+    if (result == 0)
+        result = save_hist(result_hist, bin_count, min, max,
+                argv[5U + file_count], 1);
+    if (result == 0 && opts.index)
+        result = save_hist_index_for(result_hist, bin_count, min, max,
+                argv[5U + file_count]);
 
-    save_hist_to_file(result_hist, bin_count, argv[5U + file_count], 1);
-    
-    return 0;
+    free_block(result_hist, sizeof(size_t) * bin_count);
+
+    return result != 0;
 }
 
@@ -0,0 +1,299 @@
+#include "sparse.h"
+#include "helper.h"
+
+#include <memory.h>
+#include <stdio.h>
+
+#define SPARSE_INITIAL_CAPACITY 1024
+
+// Slots store bin + 1 so that 0 marks an empty slot
+#define EMPTY_SLOT 0
+
+static size_t
+slot_of(const struct sparse_hist *sh, size_t bin) {
+    // Fibonacci hashing, capacity is a power of two
+    return (size_t)((bin * 0x9E3779B97F4A7C15UL) >> 32) & (sh->capacity - 1);
+}
+
+static int
+sparse_hist_alloc(struct sparse_hist *sh, size_t capacity) {
+    sh->capacity = capacity;
+    sh->used = 0;
+    sh->bins = (size_t *)calloc(capacity, sizeof(size_t));
+    sh->counts = (size_t *)calloc(capacity, sizeof(size_t));
+    if (!sh->bins || !sh->counts) {
+        perror("calloc");
+        free(sh->bins);
+        free(sh->counts);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+sparse_hist_grow(struct sparse_hist *sh) {
+    size_t *bins = sh->bins;
+    size_t *counts = sh->counts;
+    size_t capacity = sh->capacity;
+
+    if (sparse_hist_alloc(sh, capacity * 2) != 0) {
+        sh->bins = bins;
+        sh->counts = counts;
+        sh->capacity = capacity;
+        return 1;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (bins[i] != EMPTY_SLOT)
+            sparse_hist_add(sh, bins[i] - 1, counts[i]);
+    }
+
+    free(bins);
+    free(counts);
+
+    return 0;
+}
+
+int
+hist_should_be_sparse(size_t n, size_t bin_count) {
+    if (bin_count < SPARSE_MIN_BINS) return 0;
+
+    // At most n bins can be occupied
+    size_t occupied = n < bin_count ? n : bin_count;
+    return occupied < bin_count / SPARSE_RATIO;
+}
+
+struct sparse_hist *
+sparse_hist_create(size_t bin_count) {
+    if (bin_count == 0) {
+        EINVALID_ARGS("sparse_hist_create");
+        return NULL;
+    }
+
+    struct sparse_hist *sh = (struct sparse_hist *)malloc(sizeof(*sh));
+    if (!sh) {
+        perror("malloc");
+        return NULL;
+    }
+
+    sh->bin_count = bin_count;
+    if (sparse_hist_alloc(sh, SPARSE_INITIAL_CAPACITY) != 0) {
+        free(sh);
+        return NULL;
+    }
+
+    return sh;
+}
+
+void
+sparse_hist_destroy(struct sparse_hist *sh) {
+    if (!sh) return;
+
+    safe_free(sh->bins, sizeof(size_t) * sh->capacity);
+    safe_free(sh->counts, sizeof(size_t) * sh->capacity);
+    safe_free(sh, sizeof(*sh));
+}
+
+int
+sparse_hist_add(struct sparse_hist *sh, size_t bin, size_t count) {
+    if (!sh || bin >= sh->bin_count) {
+        EINVALID_ARGS("sparse_hist_add");
+        return 1;
+    }
+
+    // Keep load factor under 1/2
+    if (2 * (sh->used + 1) > sh->capacity && sparse_hist_grow(sh) != 0)
+        return 1;
+
+    size_t slot = slot_of(sh, bin);
+    while (sh->bins[slot] != EMPTY_SLOT && sh->bins[slot] != bin + 1)
+        slot = (slot + 1) & (sh->capacity - 1);
+
+    if (sh->bins[slot] == EMPTY_SLOT) {
+        sh->bins[slot] = bin + 1;
+        sh->used++;
+    }
+    sh->counts[slot] += count;
+
+    return 0;
+}
+
+size_t
+sparse_hist_get(const struct sparse_hist *sh, size_t bin) {
+    if (!sh || bin >= sh->bin_count) return 0;
+
+    size_t slot = slot_of(sh, bin);
+    while (sh->bins[slot] != EMPTY_SLOT) {
+        if (sh->bins[slot] == bin + 1) return sh->counts[slot];
+        slot = (slot + 1) & (sh->capacity - 1);
+    }
+
+    return 0;
+}
+
+static int
+compare_bins(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+size_t *
+sparse_hist_sorted_bins(const struct sparse_hist *sh) {
+    size_t *order = (size_t *)malloc(sizeof(size_t) * (sh->used + 1));
+    if (!order) {
+        perror("malloc");
+        return NULL;
+    }
+
+    size_t k = 0;
+    for (size_t i = 0; i < sh->capacity; i++) {
+        if (sh->bins[i] != EMPTY_SLOT) order[k++] = sh->bins[i] - 1;
+    }
+    qsort(order, k, sizeof(size_t), &compare_bins);
+
+    return order;
+}
+
+void
+sparse_hist_add_to(const struct sparse_hist *sh, size_t *dest) {
+    for (size_t i = 0; i < sh->capacity; i++) {
+        if (sh->bins[i] != EMPTY_SLOT) dest[sh->bins[i] - 1] += sh->counts[i];
+    }
+}
+
+int
+sparse_hist_merge(struct sparse_hist *dest, const struct sparse_hist *sh) {
+    for (size_t i = 0; i < sh->capacity; i++) {
+        if (sh->bins[i] == EMPTY_SLOT) continue;
+        if (sparse_hist_add(dest, sh->bins[i] - 1, sh->counts[i]) != 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+struct sparse_hist *
+sparse_hist(const double *src, size_t n,
+        double min, double max, size_t bin_count) {
+    if (!src || bin_count == 0) {
+        EINVALID_ARGS("sparse_hist");
+        return NULL;
+    }
+
+    if (min > max) {
+        max = max + min;
+        min = max - min;
+        max = max - min;
+    }
+
+    struct sparse_hist *sh = sparse_hist_create(bin_count);
+    if (!sh) return NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t j = hist_bin_index(src[i], min, max, bin_count);
+        if (j == HIST_NO_BIN) continue;
+
+        if (sparse_hist_add(sh, j, 1) != 0) {
+            sparse_hist_destroy(sh);
+            return NULL;
+        }
+    }
+
+    return sh;
+}
+
+int
+save_sparse_hist_to_file(const struct sparse_hist *sh,
+        double min, double max, const char *filename) {
+    if (!sh || !filename) return 1;
+
+    size_t *order = sparse_hist_sorted_bins(sh);
+    if (!order) return 1;
+
+    size_t k = sh->used;
+    struct text_writer w;
+    if (text_writer_open(&w, filename, k) != 0) {
+        safe_free(order, sizeof(size_t) * (sh->used + 1));
+        return 1;
+    }
+
+    // Edges are printed to round-trip exactly
+    char header[128];
+    snprintf(header, sizeof(header), "%c %lu %.17g %.17g\n",
+            HIST_SPARSE_MARK, sh->bin_count,
+            min < max ? min : max, min < max ? max : min);
+
+    int result = text_writer_text(&w, header);
+    for (size_t i = 0; i < k && result == 0; i++) {
+        result = text_writer_line(&w, order[i] + 1,
+                sparse_hist_get(sh, order[i]), 1);
+    }
+
+    if (text_writer_close(&w) != 0) result = 1;
+    safe_free(order, sizeof(size_t) * (sh->used + 1));
+
+    return result;
+}
+
+int
+save_sparse_hist_to_binary_file(const struct sparse_hist *sh,
+        double min, double max, const char *filename) {
+    if (!sh || !filename) return 1;
+
+    size_t *order = sparse_hist_sorted_bins(sh);
+    if (!order) return 1;
+
+    size_t k = sh->used;
+    size_t *pairs = (size_t *)malloc(sizeof(size_t) * (2 * k + 1));
+    if (!pairs) {
+        perror("malloc");
+        safe_free(order, sizeof(size_t) * (sh->used + 1));
+        return 1;
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        pairs[2 * i] = order[i];
+        pairs[2 * i + 1] = sparse_hist_get(sh, order[i]);
+    }
+
+    int result = save_counts_to_binary_file(HIST_SPARSE_MAGIC, pairs, 2 * k,
+            sh->bin_count, min, max, filename);
+
+    safe_free(pairs, sizeof(size_t) * (2 * k + 1));
+    safe_free(order, sizeof(size_t) * (sh->used + 1));
+
+    return result;
+}
+
+int
+save_sparse_hist(const struct sparse_hist *sh,
+        double min, double max, const char *filename) {
+    if (hist_file_is_binary(filename))
+        return save_sparse_hist_to_binary_file(sh, min, max, filename);
+
+    return save_sparse_hist_to_file(sh, min, max, filename);
+}
+
+static void
+sparse_add(void *ctx, size_t bin, size_t count) {
+    sparse_hist_add((struct sparse_hist *)ctx, bin, count);
+}
+
+int
+merge_sparse_hist_files(struct sparse_hist *dest,
+        const char *filename_prefix, size_t hist_count) {
+    if (!dest) return 1;
+    if (!filename_prefix) return 1;
+
+    int result = 0;
+    for (size_t i = 0; i < hist_count && result == 0; i++) {
+        char *fname = hist_file_name(filename_prefix, i + 1);
+        if (!fname) return 1;
+
+        result = read_hist_file(fname, dest->bin_count, &sparse_add, dest);
+        free(fname);
+    }
+
+    return result;
+}
@@ -0,0 +1,120 @@
+#ifndef PROJECT1_SPARSE_H
+#define PROJECT1_SPARSE_H
+
+#include <stdlib.h>
+
+/// Minimum number of bins before a sparse histogram is considered
+#define SPARSE_MIN_BINS 65536
+
+/// A histogram is sparse if fewer than 1 / SPARSE_RATIO of bins are used
+#define SPARSE_RATIO 8
+
+/// Histogram holding only non-empty bins in an open-addressing hash
+struct sparse_hist {
+    size_t  bin_count;
+    size_t  capacity;
+    size_t  used;
+    size_t  *bins;
+    size_t  *counts;
+};
+
+/// Decide whether a histogram should be kept sparse
+/// \param n Estimated number of samples
+/// \param bin_count Number of bins
+/// \return Non-zero if sparse representation uses less memory
+int
+hist_should_be_sparse(size_t n, size_t bin_count);
+
+/// Create an empty sparse histogram
+/// \param bin_count Number of bins
+/// \return A new sparse histogram to be released with sparse_hist_destroy
+struct sparse_hist *
+sparse_hist_create(size_t bin_count);
+
+/// Release a sparse histogram
+/// \param sh Sparse histogram to release
+void
+sparse_hist_destroy(struct sparse_hist *sh);
+
+/// Add count to a bin
+/// \param sh Sparse histogram
+/// \param bin Index of the bin
+/// \param count Number to add
+int
+sparse_hist_add(struct sparse_hist *sh, size_t bin, size_t count);
+
+/// Get count of a bin
+/// \param sh Sparse histogram
+/// \param bin Index of the bin
+/// \return Number of items in the bin
+size_t
+sparse_hist_get(const struct sparse_hist *sh, size_t bin);
+
+/// Get occupied bins in increasing order
+/// \param sh Sparse histogram
+/// \return A new malloc-ed array of sh->used bins
+size_t *
+sparse_hist_sorted_bins(const struct sparse_hist *sh);
+
+/// Add counts of a sparse histogram into a dense one
+/// \param sh Sparse histogram
+/// \param dest Dense histogram of sh->bin_count bins
+void
+sparse_hist_add_to(const struct sparse_hist *sh, size_t *dest);
+
+/// Add counts of a sparse histogram into another
+/// \param dest Sparse histogram of sh->bin_count bins
+/// \param sh Sparse histogram to add
+int
+sparse_hist_merge(struct sparse_hist *dest, const struct sparse_hist *sh);
+
+/// Create a sparse histogram, see hist
+/// \param src Source data
+/// \param n  Number of items in src
+/// \param min Minimum number
+/// \param max Maximum number
+/// \param bin_count Number of bins
+/// \return A new sparse histogram
+struct sparse_hist *
+sparse_hist(const double *src, size_t n,
+        double min, double max, size_t bin_count);
+
+/// Write non-empty bins with bin numbers in increasing bin order, after
+/// a line with the bin count and edges, see HIST_SPARSE_MARK
+/// \param sh Histogram to write
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+int
+save_sparse_hist_to_file(const struct sparse_hist *sh,
+        double min, double max, const char *filename);
+
+/// Write non-empty bins as (bin, count) pairs in increasing bin order
+/// behind a binary header with HIST_SPARSE_MAGIC
+/// \param sh Histogram to write
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+int
+save_sparse_hist_to_binary_file(const struct sparse_hist *sh,
+        double min, double max, const char *filename);
+
+/// Write a sparse histogram in binary format if filename ends with
+/// HIST_BINARY_EXT, as text otherwise
+/// \param sh Histogram to write
+/// \param min Minimum value of the histogram
+/// \param max Maximum value of the histogram
+/// \param filename Name of the file to write
+int
+save_sparse_hist(const struct sparse_hist *sh,
+        double min, double max, const char *filename);
+
+/// Merge multiple histogram files, named as by hist_file_name, into dest
+/// \param dest Destination histogram
+/// \param filename_prefix Prefix for name of the files containing histogram data
+/// \param hist_count Number of files containing histogram data
+int
+merge_sparse_hist_files(struct sparse_hist *dest,
+        const char *filename_prefix, size_t hist_count);
+
+#endif //PROJECT1_SPARSE_H
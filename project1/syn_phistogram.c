@@ -4,38 +4,114 @@
 #include <unistd.h>
 
 #include "helper.h"
+#include "cumulative.h"
+#include "live.h"
+#include "multires.h"
 
-#define SEM_NAME "/histsem"
+#define OPTIONS "HTNRIL"
 
-#define SHM_NAME "/histshm"
+#define SEM_NAME LIVE_SEM_NAME
+
+#define SEM_NAME_MAX 32
+
+#define SHM_NAME LIVE_SHM_NAME
+
+static void
+unlink_sems(size_t node_count) {
+    char sem_name[SEM_NAME_MAX];
+
+    for (size_t node = 0; node < node_count; node++) {
+        snprintf(sem_name, SEM_NAME_MAX, SEM_NAME "%lu", node);
+        sem_unlink(sem_name);
+    }
+}
+
+static void
+print_syn_usage(void) {
+    print_usage("syn_phistogram", OPTIONS);
+    printf("\tWith -N the shared histogram has a slice per NUMA node,"
+           " reduced when read\n");
+}
 
 int
 main(int argc, char **argv) {
+    struct hist_options opts;
+    int first_arg = parse_options(argc, argv, OPTIONS, &opts);
+    if (first_arg == -1) {
+        print_syn_usage();
+        return 1;
+    }
+
+    // Skip options so positional arguments start at argv[1]
+    argc -= first_arg - 1;
+    argv += first_arg - 1;
+
     if (argc < 6) {
-        print_usage("syn_phistogram");
+        print_syn_usage();
         return 0;
     }
 
     double min, max;
     size_t bin_count, file_count;
     size_t shm_size;
+    size_t node_count = (size_t)opts.node_count;
+    size_t slice_count = node_count;
+    char sem_name[SEM_NAME_MAX];
 
     sscanf(argv[1], "%lf", &min);
     sscanf(argv[2], "%lf", &max);
     sscanf(argv[3], "%lu", &bin_count);
     sscanf(argv[4], "%lu", &file_count);
-    shm_size = sizeof(int) * bin_count;
 
     if ((size_t)argc < (6U + file_count)) {
-        print_usage("syn_phistogram");
+        print_syn_usage();
         return 0;
     }
 
-    if (create_sem(SEM_NAME) == -1) exit(EXIT_FAILURE);
+    // Answer from a finer histogram built earlier if possible
+    if (try_derive_hist_file("syn_phistogram", opts.base_file, min, max,
+                bin_count, argv[5U + file_count], opts.index) == 0)
+        return 0;
+
+    // One slice of bins per NUMA node, reduced when read. A kept
+    // histogram is added into with the slices it was created with.
+    int reuse = opts.live ?
+        live_hist_reuse(SHM_NAME, min, max, bin_count, &slice_count) : 1;
+    if (reuse == -1) exit(EXIT_FAILURE);
+
+    // A plain run cannot share a histogram kept by -L
+    size_t kept_size;
+    const void *kept = opts.live ? NULL :
+        live_hist_attach(SHM_NAME, &kept_size);
+    if (kept) {
+        live_hist_detach(kept, kept_size);
+        ERROR("syn_phistogram", SHM_NAME " is kept by an earlier -L run,"
+                " remove it with hwatch -d");
+        exit(EXIT_FAILURE);
+    }
 
-    if (create_shm(SHM_NAME, shm_size) == -1)
+    if (reuse == 1 &&
+            live_hist_create(SHM_NAME, min, max, bin_count, slice_count) == -1)
         exit(EXIT_FAILURE);
 
+    shm_size = live_hist_size(bin_count, slice_count);
+
+    // Producers adding into a kept histogram share its semaphores, so
+    // they are opened rather than created and left in place on exit
+    for (size_t slice = 0; slice < slice_count; slice++) {
+        snprintf(sem_name, SEM_NAME_MAX, SEM_NAME "%lu", slice);
+        if ((opts.live ? reuse_sem(sem_name) : create_sem(sem_name)) == -1)
+            exit(EXIT_FAILURE);
+    }
+
+    int fd;
+    void *shmp = get_shm(SHM_NAME, shm_size, &fd);
+    if (shmp == NULL) exit(EXIT_FAILURE);
+
+    live_hist_start(shmp, file_count);
+
+    cleanup_shm(shmp, SHM_NAME, shm_size, fd);
+
     pid_t pid;
     for (size_t i = 5; i < file_count + 5; i++) {
         if ((pid = fork()) == -1) {
@@ -44,29 +120,30 @@ main(int argc, char **argv) {
         }
 
         if (pid == 0) {
-            size_t lines = line_count(argv[i]);
-            size_t *hist = hist_from_file(argv[i], lines, min, max, bin_count);
+            size_t node = (i - 5) % node_count;
+            size_t slice = (i - 5) % slice_count;
+            if (opts.numa) pin_to_numa_node((int)node);
+            snprintf(sem_name, SEM_NAME_MAX, SEM_NAME "%lu", slice);
+
+            size_t *hist = hist_from_file(argv[i], min, max, bin_count);
             if (hist == NULL) {
                 _exit(EXIT_FAILURE);
             }
 
-            sem_t *sem = open_wait_sem(SEM_NAME);
+            sem_t *sem = open_wait_sem(sem_name);
             if (sem == NULL) _exit(EXIT_FAILURE);
 
-            int fd;
-            size_t *shmp = (size_t *)get_shm(SHM_NAME, shm_size, &fd);
+            shmp = get_shm(SHM_NAME, shm_size, &fd);
             if (shmp == NULL) _exit(EXIT_FAILURE);
 
-            for (size_t i = 0; i < bin_count; i++) {
-                shmp[i] += hist[i];
-            }
+            live_hist_add(shmp, slice, hist);
 
-            safe_free(hist, sizeof(size_t) * bin_count);
+            free_block(hist, sizeof(size_t) * bin_count);
 
             if (cleanup_shm(shmp, SHM_NAME, shm_size, fd) == -1)
                 _exit(EXIT_FAILURE);
 
-            if (post_close_sem(sem, SEM_NAME) == -1)
+            if (post_close_sem(sem, sem_name) == -1)
                 _exit(EXIT_FAILURE);
 
             _exit(EXIT_SUCCESS);
@@ -79,26 +156,42 @@ main(int argc, char **argv) {
         wait(&status);
 
         if (status != EXIT_SUCCESS) {
-            sem_unlink(SEM_NAME);
-            shm_unlink(SHM_NAME);
+            if (!opts.live) {
+                unlink_sems(slice_count);
+                unlink_shm(SHM_NAME);
+            }
             exit(EXIT_FAILURE);
         }
 
         --pid_count;
     }
 
-    sem_unlink(SEM_NAME);
+    if (!opts.live) unlink_sems(slice_count);
 
-    int fd;
-    size_t *shmp = (size_t *)get_shm(SHM_NAME, shm_size, &fd);
+    shmp = get_shm(SHM_NAME, shm_size, &fd);
     if (shmp == NULL) exit(EXIT_FAILURE);
 
-    save_hist_to_file(shmp, bin_count, argv[5U + file_count], 1);
+    // Cross-node merge of the node-local histograms
+    size_t *result_hist = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    if (result_hist == NULL ||
+            live_hist_snapshot(shmp, result_hist, NULL) != 0) {
+        if (!opts.live) unlink_shm(SHM_NAME);
+        exit(EXIT_FAILURE);
+    }
 
     cleanup_shm(shmp, SHM_NAME, shm_size, fd);
 
-    shm_unlink(SHM_NAME);
+    // A live histogram stays for monitors and later producers
+    if (!opts.live) unlink_shm(SHM_NAME);
+
+    int status_save = save_hist(result_hist, bin_count, min, max,
+            argv[5U + file_count], 1);
+    if (status_save == 0 && opts.index)
+        status_save = save_hist_index_for(result_hist, bin_count, min, max,
+                argv[5U + file_count]);
+
+    free_block(result_hist, sizeof(size_t) * bin_count);
 
-    exit(EXIT_SUCCESS);
+    exit(status_save == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
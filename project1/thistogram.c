@@ -4,6 +4,11 @@
 #include <stdlib.h>
 
 #include "helper.h"
+#include "cumulative.h"
+#include "multires.h"
+#include "sparse.h"
+
+#define OPTIONS "HNBRI"
 
 
 static double min, max;
@@ -14,6 +19,8 @@ struct thread_info {
     pthread_t   thread_id;
     size_t      thread_num;
     const char  *filename;
+    int         node;
+    int         status;
 };
 
 
@@ -21,12 +28,16 @@ void *
 thread_function(void *arg) {
     struct thread_info *tinfo = arg;
 
-    char ofname[256];
-    snprintf(ofname, 256, "hist%lu.txt", tinfo->thread_num);
+    if (tinfo->node >= 0)
+        pin_to_numa_node(tinfo->node);
+
+    tinfo->status = 1;
+    char *ofname = hist_file_name("hist", tinfo->thread_num);
+    if (ofname == NULL) return NULL;
 
-    size_t lines = line_count(tinfo->filename);
-    hist_from_file_to_file(tinfo->filename, lines,
+    tinfo->status = hist_from_file_to_file(tinfo->filename,
             min, max, bin_count, ofname);
+    free(ofname);
 
     return NULL;
 }
@@ -34,8 +45,19 @@ thread_function(void *arg) {
 
 int
 main(int argc, char **argv) {
+    struct hist_options opts;
+    int first_arg = parse_options(argc, argv, OPTIONS, &opts);
+    if (first_arg == -1) {
+        print_usage("thistogram", OPTIONS);
+        return 1;
+    }
+
+    // Skip options so positional arguments start at argv[1]
+    argc -= first_arg - 1;
+    argv += first_arg - 1;
+
     if (argc < 6) {
-        print_usage("thistogram");
+        print_usage("thistogram", OPTIONS);
         return 0;
     }
 
@@ -47,10 +69,15 @@ main(int argc, char **argv) {
     sscanf(argv[4], "%lu", &file_count);
 
     if ((size_t)argc < (6U + file_count)) {
-        print_usage("thistogram");
+        print_usage("thistogram", OPTIONS);
         return 0;
     }
 
+    // Answer from a finer histogram built earlier if possible
+    if (try_derive_hist_file("thistogram", opts.base_file, min, max,
+                bin_count, argv[5U + file_count], opts.index) == 0)
+        return 0;
+
     struct thread_info *tinfo = calloc(file_count, sizeof(*tinfo));
     if (tinfo == NULL) {
         perror("calloc");
@@ -60,6 +87,7 @@ main(int argc, char **argv) {
     for (size_t i = 0; i < file_count; i++) {
         tinfo[i].thread_num = i + 1;
         tinfo[i].filename = argv[i + 5];
+        tinfo[i].node = opts.numa ? (int)(i % opts.node_count) : -1;
 
         if (pthread_create(&tinfo[i].thread_id, NULL,
                     &thread_function, &tinfo[i]) != 0) {
@@ -73,17 +101,50 @@ main(int argc, char **argv) {
             perror("pthread_join");
             return 1;
         }
+        if (tinfo[i].status != 0) return 1;
     }
 
     safe_free(tinfo, sizeof(*tinfo));
 
-    size_t result_hist[bin_count];
+    // Keep the result sparse if few bins can be occupied
+    size_t sample_estimate = 0;
+    for (size_t i = 5; i < file_count + 5; i++)
+        sample_estimate += estimate_sample_count(argv[i]);
+
+    if (hist_should_be_sparse(sample_estimate, bin_count)) {
+        struct sparse_hist *sh = sparse_hist_create(bin_count);
+        if (sh == NULL) return 1;
+
+        if (merge_sparse_hist_files(sh, "hist", file_count) != 0) {
+            sparse_hist_destroy(sh);
+            return 1;
+        }
+
+        int status = save_sparse_hist(sh, min, max, argv[5U + file_count]);
+        if (status == 0 && opts.index)
+            status = save_sparse_hist_index_for(sh, min, max,
+                    argv[5U + file_count]);
+        sparse_hist_destroy(sh);
+
+        return status;
+    }
+
+    // Merge histograms from intermediate files, on the heap as there may
+    // be too many bins for the stack
+    size_t *result_hist = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    if (result_hist == NULL) return 1;
     memset(result_hist, 0, sizeof(size_t) * bin_count);
 
-    merge_hist_files(result_hist, bin_count, "hist", file_count);
+    int result = merge_hist_files(result_hist, bin_count, "hist", file_count);
+    if (result == 0)
+        result = save_hist(result_hist, bin_count, min, max,
+                argv[5U + file_count], 1);
+    if (result == 0 && opts.index)
+        result = save_hist_index_for(result_hist, bin_count, min, max,
+                argv[5U + file_count]);
 
-    save_hist_to_file(result_hist, bin_count, argv[5U + file_count], 1);
+    free_block(result_hist, sizeof(size_t) * bin_count);
 
-    return 0;
+    return result != 0;
 }
 
@@ -0,0 +1,172 @@
+#include <pthread.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "hist2d.h"
+#include "sparse.h"
+
+
+struct shared_info {
+    char                **filenames;
+    size_t              file_count;
+    size_t              next_file;
+    size_t              thread_count;
+    size_t              **partials;
+    size_t              cell_count;
+    pthread_barrier_t   barrier;
+    int                 numa;
+    int                 node_count;
+    int                 failed;
+};
+
+struct thread_info {
+    pthread_t           thread_id;
+    size_t              thread_num;
+    struct hist2d       grid;
+    struct shared_info  *shared;
+};
+
+
+void *
+thread_function(void *arg) {
+    struct thread_info *tinfo = arg;
+    struct shared_info *shared = tinfo->shared;
+
+    if (shared->numa)
+        pin_to_numa_node((int)(tinfo->thread_num % shared->node_count));
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&shared->next_file, 1,
+                __ATOMIC_RELAXED);
+        if (i >= shared->file_count) break;
+
+        if (hist2d_add_file(&tinfo->grid, shared->filenames[i]) != 0)
+            __atomic_store_n(&shared->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    hist_tree_reduce(shared->partials, tinfo->thread_num,
+            shared->thread_count, shared->cell_count, &shared->barrier);
+
+    return NULL;
+}
+
+static void
+print_usage_2d(void) {
+    printf("Usage:\n");
+    printf("\tthistogram2d [-H] [-N] [XMINVAL] [XMAXVAL]"
+           " [XBINCOUNT] [YMINVAL] [YMAXVAL] [YBINCOUNT] [FILECOUNT]"
+           " [IFILE]... [OFILE]\n");
+    printf("\tEvery line of an IFILE holds an x and a y value\n");
+}
+
+
+int
+main(int argc, char **argv) {
+    struct hist_options opts;
+    int first_arg = parse_options(argc, argv, "HN", &opts);
+    if (first_arg == -1) {
+        print_usage_2d();
+        return 1;
+    }
+
+    // Skip options so positional arguments start at argv[1]
+    argc -= first_arg - 1;
+    argv += first_arg - 1;
+
+    if (argc < 9) {
+        print_usage_2d();
+        return 0;
+    }
+
+    double xmin = 0.0, xmax = 0.0, ymin = 0.0, ymax = 0.0;
+    size_t xbins = 0, ybins = 0;
+    size_t file_count = 0;
+
+    sscanf(argv[1], "%lf", &xmin);
+    sscanf(argv[2], "%lf", &xmax);
+    sscanf(argv[3], "%lu", &xbins);
+    sscanf(argv[4], "%lf", &ymin);
+    sscanf(argv[5], "%lf", &ymax);
+    sscanf(argv[6], "%lu", &ybins);
+    sscanf(argv[7], "%lu", &file_count);
+
+    if ((size_t)argc < (9U + file_count) || file_count == 0) {
+        print_usage_2d();
+        return 0;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t thread_count = cpus > 0 ? (size_t)cpus : 1;
+    if (thread_count > file_count) thread_count = file_count;
+
+    struct shared_info shared;
+    memset(&shared, 0, sizeof(shared));
+    shared.filenames = argv + 8;
+    shared.file_count = file_count;
+    shared.thread_count = thread_count;
+    shared.numa = opts.numa;
+    shared.node_count = opts.node_count;
+
+    struct thread_info *tinfo = calloc(thread_count, sizeof(*tinfo));
+    shared.partials = calloc(thread_count, sizeof(size_t *));
+    if (tinfo == NULL || shared.partials == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (hist2d_init(&tinfo[i].grid, xmin, xmax, xbins,
+                    ymin, ymax, ybins) != 0)
+            return 1;
+
+        tinfo[i].thread_num = i;
+        tinfo[i].shared = &shared;
+        shared.partials[i] = tinfo[i].grid.cells;
+    }
+    shared.cell_count = tinfo[0].grid.cell_count;
+
+    if (pthread_barrier_init(&shared.barrier, NULL,
+                (unsigned int)thread_count) != 0) {
+        perror("pthread_barrier_init");
+        return 1;
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&tinfo[i].thread_id, NULL,
+                    &thread_function, &tinfo[i]) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_join(tinfo[i].thread_id, NULL) != 0) {
+            perror("pthread_join");
+            return 1;
+        }
+    }
+
+    pthread_barrier_destroy(&shared.barrier);
+
+    if (shared.failed) return 1;
+
+    // Keep the output sparse if few cells can be occupied
+    size_t sample_estimate = 0;
+    for (size_t i = 0; i < file_count; i++)
+        sample_estimate += estimate_sample_count(argv[8 + i]) / 2;
+
+    int sparse = hist_should_be_sparse(sample_estimate, xbins * ybins);
+    int result = save_hist2d_to_file(&tinfo[0].grid,
+            argv[8U + file_count], sparse);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        hist2d_destroy(&tinfo[i].grid);
+    }
+    safe_free(shared.partials, sizeof(size_t *) * thread_count);
+    safe_free(tinfo, sizeof(*tinfo) * thread_count);
+
+    return result;
+}
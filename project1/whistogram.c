@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "helper.h"
+#include "window.h"
+
+/// Bytes of input read at once
+#define READ_CHUNK 65536
+
+
+static void
+print_window_usage(void) {
+    printf("Usage:\n");
+    printf("\twhistogram [-t] [MINVAL] [MAXVAL] [BINCOUNT] [INTERVALS]"
+           " [LENGTH] [OFILE]\n");
+    printf("\tReads numbers from standard input. An interval is LENGTH"
+           " numbers, or LENGTH seconds with -t.\n");
+    printf("\tAfter every interval OFILE is replaced with the histogram"
+           " of the last INTERVALS intervals.\n");
+}
+
+static double
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/// Window fed from standard input
+struct window_state {
+    struct window_hist  wh;
+    size_t              *snapshot;
+    const char          *ofname;
+    char                *tmpname;
+    int                 timed;
+    double              length;
+    size_t              interval_length;    // samples, if not timed
+    size_t              in_interval;
+    size_t              rotations;
+    double              interval_start;     // seconds, if timed
+    int                 result;
+};
+
+/// Replace ofname with a snapshot so readers never see a partial file
+static int
+write_snapshot(const struct window_hist *wh, size_t *snapshot,
+        const char *ofname, const char *tmpname) {
+    window_hist_snapshot(wh, snapshot);
+
+    int result = save_hist(snapshot, wh->bin_count, wh->min, wh->max,
+            tmpname, 1);
+
+    if (result == 0 && rename(tmpname, ofname) == -1) {
+        perror("rename");
+        result = 1;
+    }
+
+    return result;
+}
+
+/// Parse the whole numbers in buf, leaving an unfinished one at its
+/// start unless at_end, and add them to the window
+/// \return Number of bytes consumed, or -1 on input that is no number
+static ssize_t
+add_numbers(struct window_state *ws, char *buf, size_t len, int at_end) {
+    // Numbers before the last separator are complete
+    size_t end = len;
+    if (!at_end) {
+        while (end > 0 && !isspace((unsigned char)buf[end - 1])) end--;
+    }
+
+    char *p = buf;
+    buf[len] = '\0';
+    while (ws->result == 0) {
+        while (p < buf + end && isspace((unsigned char)*p)) p++;
+        if (p == buf + end) break;
+
+        char *q;
+        double x = strtod(p, &q);
+        if (q == p) return -1;
+        p = q;
+
+        window_hist_add(&ws->wh, &x, 1);
+        ws->in_interval++;
+
+        // Written as soon as the interval is full, the next sample may
+        // be long in coming
+        if (!ws->timed && ws->in_interval == ws->interval_length) {
+            ws->result = write_snapshot(&ws->wh, ws->snapshot, ws->ofname,
+                    ws->tmpname);
+            window_hist_advance(&ws->wh, 1);
+            ws->in_interval = 0;
+            ws->rotations++;
+        }
+    }
+
+    return p - buf;
+}
+
+/// Rotate past intervals that ended, by the clock
+/// \return Milliseconds until the current interval ends
+static int
+rotate_by_clock(struct window_state *ws) {
+    double t = now();
+    size_t elapsed = (size_t)((t - ws->interval_start) / ws->length);
+
+    if (elapsed > 0) {
+        ws->result = write_snapshot(&ws->wh, ws->snapshot, ws->ofname,
+                ws->tmpname);
+        window_hist_advance(&ws->wh, elapsed);
+        ws->interval_start += (double)elapsed * ws->length;
+    }
+
+    double left = ws->interval_start + ws->length - t;
+    return left > 0.0 ? (int)(left * 1000.0) + 1 : 0;
+}
+
+
+int
+main(int argc, char **argv) {
+    struct window_state ws;
+    memset(&ws, 0, sizeof(ws));
+
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        ws.timed = 1;
+        argc--;
+        argv++;
+    }
+
+    if (argc < 7) {
+        print_window_usage();
+        return 0;
+    }
+
+    double min = 0.0, max = 0.0;
+    size_t bin_count = 0, interval_count = 0;
+
+    sscanf(argv[1], "%lf", &min);
+    sscanf(argv[2], "%lf", &max);
+    sscanf(argv[3], "%lu", &bin_count);
+    sscanf(argv[4], "%lu", &interval_count);
+    sscanf(argv[5], "%lf", &ws.length);
+    ws.ofname = argv[6];
+
+    // An interval of samples is a whole number of them
+    ws.interval_length = (size_t)ws.length;
+    if (ws.length <= 0.0 || (!ws.timed &&
+                (ws.interval_length == 0 ||
+                 (double)ws.interval_length != ws.length))) {
+        EINVALID_ARGS("whistogram");
+        return 1;
+    }
+
+    if (window_hist_init(&ws.wh, min, max, bin_count, interval_count) != 0)
+        return 1;
+
+    ws.snapshot = (size_t *)alloc_block(sizeof(size_t) * bin_count);
+    char *buf = (char *)malloc(READ_CHUNK + 1);
+    if (!ws.snapshot || !buf || asprintf(&ws.tmpname, "%s.tmp%s", ws.ofname,
+                hist_file_is_binary(ws.ofname) ? HIST_BINARY_EXT : "") == -1) {
+        free(buf);
+        window_hist_destroy(&ws.wh);
+        return 1;
+    }
+
+    ws.interval_start = now();
+    size_t len = 0;
+    int at_end = 0;
+
+    while (ws.result == 0 && !at_end) {
+        // Intervals end on time even while no input arrives
+        int timeout = -1;
+        if (ws.timed) {
+            timeout = rotate_by_clock(&ws);
+            if (ws.result != 0) break;
+        }
+
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready == -1 && errno == EINTR) continue;
+        if (ready == -1) {
+            perror("poll");
+            ws.result = 1;
+            break;
+        }
+        if (ready == 0) continue;
+
+        ssize_t got = read(STDIN_FILENO, buf + len, READ_CHUNK - len);
+        if (got == -1 && errno == EINTR) continue;
+        if (got == -1) {
+            perror("read");
+            ws.result = 1;
+            break;
+        }
+
+        len += (size_t)got;
+        at_end = got == 0;
+
+        // Numbers that just arrived belong to the interval running now
+        if (ws.timed) {
+            rotate_by_clock(&ws);
+            if (ws.result != 0) break;
+        }
+
+        // A number too long for the buffer is no number either
+        ssize_t used = add_numbers(&ws, buf, len, at_end);
+        if (used == -1 || (used == 0 && len == READ_CHUNK)) {
+            ERROR("whistogram", "input is not a number");
+            ws.result = 1;
+            break;
+        }
+
+        len -= (size_t)used;
+        memmove(buf, buf + used, len);
+    }
+
+    // The last full interval of samples was written before rotating
+    if (ws.result == 0 &&
+            (ws.timed || ws.in_interval > 0 || ws.rotations == 0))
+        ws.result = write_snapshot(&ws.wh, ws.snapshot, ws.ofname,
+                ws.tmpname);
+
+    free(buf);
+    free(ws.tmpname);
+    free_block(ws.snapshot, sizeof(size_t) * bin_count);
+    window_hist_destroy(&ws.wh);
+
+    return ws.result;
+}
@@ -0,0 +1,80 @@
+#include "window.h"
+#include "helper.h"
+
+#include <memory.h>
+#include <stdio.h>
+
+int
+window_hist_init(struct window_hist *wh, double min, double max,
+        size_t bin_count, size_t interval_count) {
+    if (!wh || bin_count == 0 || interval_count == 0) {
+        EINVALID_ARGS("window_hist_init");
+        return 1;
+    }
+
+    memset(wh, 0, sizeof(*wh));
+    wh->min = min < max ? min : max;
+    wh->max = min < max ? max : min;
+    wh->bin_count = bin_count;
+    wh->interval_count = interval_count;
+
+    size_t size = sizeof(size_t) * bin_count * (interval_count + 1);
+    wh->intervals = (size_t *)alloc_block(size);
+    if (!wh->intervals) return 1;
+    memset(wh->intervals, 0, size);
+
+    // Window sum lives behind the ring
+    wh->window = wh->intervals + bin_count * interval_count;
+
+    return 0;
+}
+
+void
+window_hist_destroy(struct window_hist *wh) {
+    if (!wh || !wh->intervals) return;
+
+    free_block(wh->intervals,
+            sizeof(size_t) * wh->bin_count * (wh->interval_count + 1));
+    wh->intervals = NULL;
+    wh->window = NULL;
+}
+
+void
+window_hist_add(struct window_hist *wh, const double *src, size_t n) {
+    size_t *interval = wh->intervals + wh->current * wh->bin_count;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t j = hist_bin_index(src[i], wh->min, wh->max, wh->bin_count);
+        if (j == HIST_NO_BIN) continue;
+
+        interval[j]++;
+        wh->window[j]++;
+    }
+}
+
+void
+window_hist_advance(struct window_hist *wh, size_t intervals) {
+    // Past a whole window every interval is dropped
+    if (intervals >= wh->interval_count) {
+        memset(wh->intervals, 0,
+                sizeof(size_t) * wh->bin_count * (wh->interval_count + 1));
+        wh->current = 0;
+        return;
+    }
+
+    for (size_t k = 0; k < intervals; k++) {
+        wh->current = (wh->current + 1) % wh->interval_count;
+
+        // The slot to reuse holds the oldest interval
+        size_t *oldest = wh->intervals + wh->current * wh->bin_count;
+        for (size_t j = 0; j < wh->bin_count; j++) {
+            wh->window[j] -= oldest[j];
+        }
+        memset(oldest, 0, sizeof(size_t) * wh->bin_count);
+    }
+}
+
+void
+window_hist_snapshot(const struct window_hist *wh, size_t *dest) {
+    memcpy(dest, wh->window, sizeof(size_t) * wh->bin_count);
+}
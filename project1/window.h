@@ -0,0 +1,54 @@
+#ifndef PROJECT1_WINDOW_H
+#define PROJECT1_WINDOW_H
+
+#include <stdlib.h>
+
+/// Histogram of a sliding window over a stream, kept as a ring of
+/// per-interval histograms. The window holds the current interval and
+/// the interval_count - 1 intervals before it.
+struct window_hist {
+    double  min;
+    double  max;
+    size_t  bin_count;
+    size_t  interval_count;
+    size_t  current;
+    size_t  *intervals;
+    size_t  *window;
+};
+
+/// Create an empty sliding-window histogram
+/// \param wh Histogram to initialize, released with window_hist_destroy
+/// \param min Minimum value
+/// \param max Maximum value
+/// \param bin_count Number of bins
+/// \param interval_count Number of intervals in the window
+int
+window_hist_init(struct window_hist *wh, double min, double max,
+        size_t bin_count, size_t interval_count);
+
+/// Release a sliding-window histogram
+/// \param wh Histogram to release
+void
+window_hist_destroy(struct window_hist *wh);
+
+/// Add numbers to the current interval
+/// \param wh Histogram
+/// \param src Numbers to add
+/// \param n Number of items in src
+void
+window_hist_add(struct window_hist *wh, const double *src, size_t n);
+
+/// Start new intervals, dropping the oldest ones from the window,
+/// in O(bins) per interval
+/// \param wh Histogram
+/// \param intervals Number of intervals to advance
+void
+window_hist_advance(struct window_hist *wh, size_t intervals);
+
+/// Copy the histogram of the window
+/// \param wh Histogram
+/// \param dest Destination, bin_count long
+void
+window_hist_snapshot(const struct window_hist *wh, size_t *dest);
+
+#endif //PROJECT1_WINDOW_H